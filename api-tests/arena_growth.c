@@ -0,0 +1,23 @@
+#include "../tests/testing.h"
+
+/**
+ * This test checks that a heap keeps growing after an arena sized for a
+ * request above 256 MB: with SMALL_HEAP=1 the arenas are carved one after the
+ * other from one reservation, and must stay page aligned for the next one to
+ * be mapped.
+ **/
+
+int main(void) {
+  Heap *heap = my_heap_create();
+  CHECK_NULL(heap);
+  char *large = my_heap_malloc(heap, 300 << 20);
+  CHECK_NULL(large);
+  large[0] = large[(300 << 20) - 1] = 1;
+  for (int i = 0; i < 2; i++) {
+    char *next = my_heap_malloc(heap, 250 << 20);
+    CHECK_NULL(next);
+    next[0] = next[(250 << 20) - 1] = 1;
+  }
+  my_heap_destroy(heap);
+  return 0;
+}
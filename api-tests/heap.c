@@ -0,0 +1,56 @@
+#include "../tests/testing.h"
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/**
+ * This test checks independent heaps: their blocks come from their own
+ * arenas, leave the default heap alone, and my_heap_destroy unmaps them with
+ * blocks still allocated.
+ **/
+
+#define NALLOCS 1000
+
+static int mapped(void *ptr) {
+  unsigned char vec;
+  size_t page = sysconf(_SC_PAGESIZE);
+  return mincore((void *)((size_t)ptr & ~(page - 1)), 1, &vec) == 0;
+}
+
+int main(void) {
+  void *ptrs[NALLOCS];
+  HeapStats before, after;
+  void *own = mallocing(100);
+  my_heap_get_stats(&before);
+
+  Heap *a = my_heap_create(), *b = my_heap_create();
+  CHECK_NULL(a);
+  CHECK_NULL(b);
+  for (int i = 0; i < NALLOCS; i++) {
+    ptrs[i] = my_heap_malloc(i % 2 ? a : b, 1 + i % 200);
+    CHECK_NULL(ptrs[i]);
+    assert(((size_t)ptrs[i] & (kAlignment - 1)) == 0);
+    memset(ptrs[i], i, 1 + i % 200);
+  }
+  for (int i = 0; i < NALLOCS; i++)
+    assert(((unsigned char *)ptrs[i])[i % 200] == (unsigned char)i);
+  // Frees return blocks to their own heap: the next allocation reuses it
+  my_heap_free(a, ptrs[1]);
+  assert(my_heap_malloc(a, 1) == ptrs[1]);
+  assert(my_heap_malloc(a, 0) == NULL);
+
+  my_heap_get_stats(&after);
+  assert(after.arenas == before.arenas);
+  assert(after.allocated_blocks == before.allocated_blocks);
+
+  my_heap_destroy(a);
+  assert(!mapped(ptrs[1]));
+  assert(mapped(ptrs[0]));
+  for (int i = 0; i < NALLOCS; i += 2)
+    my_heap_free(b, ptrs[i]);
+  my_heap_destroy(b);
+  assert(!mapped(ptrs[0]));
+
+  freeing(own);
+  return 0;
+}
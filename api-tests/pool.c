@@ -0,0 +1,146 @@
+#include "../tests/testing.h"
+#include <string.h>
+#ifdef THREADSAFE
+#include <pthread.h>
+#endif
+
+/**
+ * This test checks the pool API and the heap stats: objects are aligned,
+ * distinct and reused once freed, and the stats account for pools and
+ * blocks. With THREADSAFE=1 threads share a pool, freeing each other's
+ * objects, and a thread goes on after a pool it used was destroyed.
+ **/
+
+#define NOBJECTS 10000
+#define NTHREADS 4
+
+static void *objects[NOBJECTS];
+
+#ifdef THREADSAFE
+static Pool *shared;
+
+static void *churn(void *arg) {
+  void *mine[1000];
+  (void)arg;
+  for (int round = 0; round < 100; round++) {
+    for (int i = 0; i < 1000; i++) {
+      mine[i] = my_pool_alloc(shared);
+      CHECK_NULL(mine[i]);
+      memset(mine[i], round, 48);
+    }
+    for (int i = 0; i < 1000; i++)
+      my_pool_free(shared, mine[i]);
+  }
+  return NULL;
+}
+
+static pthread_barrier_t step;
+static Pool *doomed;
+// One pool per cache slot, created after doomed
+static Pool *others[8];
+
+// Uses a pool the main thread then destroys, then pools sharing its slot
+static void *outlive(void *arg) {
+  (void)arg;
+  void *object = my_pool_alloc(doomed);
+  CHECK_NULL(object);
+  my_pool_free(doomed, object);
+  pthread_barrier_wait(&step);
+  pthread_barrier_wait(&step);
+  for (int i = 0; i < 8; i++) {
+    object = my_pool_alloc(others[i]);
+    CHECK_NULL(object);
+    my_pool_free(others[i], object);
+  }
+  return NULL;
+}
+#endif
+
+int main(void) {
+  HeapStats before, stats;
+  my_heap_get_stats(&before);
+
+  Pool *pool = my_pool_create(24, 0);
+  CHECK_NULL(pool);
+  for (int i = 0; i < NOBJECTS; i++) {
+    objects[i] = my_pool_alloc(pool);
+    CHECK_NULL(objects[i]);
+    assert(((size_t)objects[i] & (kAlignment - 1)) == 0);
+    memset(objects[i], i, 24);
+  }
+  for (int i = 0; i < NOBJECTS; i++)
+    for (int j = 0; j < 24; j++)
+      assert(((unsigned char *)objects[i])[j] == (unsigned char)i);
+
+  my_heap_get_stats(&stats);
+  assert(stats.pools == before.pools + 1);
+#ifdef POOL_CACHE
+  // This thread's cache holds the rest of the last batch
+  assert(stats.pool_objects >= NOBJECTS);
+#else
+  assert(stats.pool_objects == NOBJECTS);
+#endif
+  assert(stats.pool_bytes >= NOBJECTS * 24);
+  assert(stats.allocated_bytes >= before.allocated_bytes + stats.pool_bytes);
+  assert(stats.arenas >= 1 && stats.heap_bytes >= stats.allocated_bytes);
+
+#ifndef POOL_CACHE
+  // The last object freed is the next one handed out
+  my_pool_free(pool, objects[17]);
+  my_heap_get_stats(&stats);
+  assert(stats.pool_objects == NOBJECTS - 1 && stats.pool_free_objects == 1);
+  assert(my_pool_alloc(pool) == objects[17]);
+#endif
+  for (int i = 0; i < NOBJECTS; i++)
+    my_pool_free(pool, objects[i]);
+  my_pool_destroy(pool);
+
+  Pool *aligned = my_pool_create(100, 256);
+  CHECK_NULL(aligned);
+  for (int i = 0; i < 100; i++) {
+    objects[i] = my_pool_alloc(aligned);
+    CHECK_NULL(objects[i]);
+    assert(((size_t)objects[i] & 255) == 0);
+  }
+  my_pool_destroy(aligned);
+  assert(my_pool_create(24, 24) == NULL);
+
+  my_heap_get_stats(&stats);
+  assert(stats.pools == before.pools);
+
+#ifdef THREADSAFE
+  shared = my_pool_create(48, 16);
+  CHECK_NULL(shared);
+  pthread_t threads[NTHREADS];
+  for (int t = 0; t < NTHREADS; t++)
+    assert(pthread_create(&threads[t], NULL, churn, NULL) == 0);
+  for (int t = 0; t < NTHREADS; t++)
+    pthread_join(threads[t], NULL);
+  // Exited threads have flushed their caches
+  my_heap_get_stats(&stats);
+  assert(stats.pool_objects == 0);
+  my_pool_destroy(shared);
+
+  doomed = my_pool_create(32, 0);
+  CHECK_NULL(doomed);
+  for (int i = 0; i < 8; i++) {
+    others[i] = my_pool_create(32, 0);
+    CHECK_NULL(others[i]);
+  }
+  pthread_barrier_init(&step, NULL, 2);
+  pthread_t thread;
+  assert(pthread_create(&thread, NULL, outlive, NULL) == 0);
+  pthread_barrier_wait(&step);
+  my_pool_destroy(doomed);
+  // Reuse the chunk the other thread still caches objects from
+  void *reuse = mallocing(kPoolChunkSize);
+  memset(reuse, 0xab, kPoolChunkSize);
+  pthread_barrier_wait(&step);
+  pthread_join(thread, NULL);
+  freeing(reuse);
+  for (int i = 0; i < 8; i++)
+    my_pool_destroy(others[i]);
+  pthread_barrier_destroy(&step);
+#endif
+  return 0;
+}
@@ -0,0 +1,57 @@
+#include "../tests/testing.h"
+#include <string.h>
+
+/**
+ * This test checks the region API: allocations are word aligned and don't
+ * overlap, a reset reuses the same chunks, allocations larger than a chunk
+ * get their own, and destroy gives the chunks back to the heap.
+ **/
+
+#define NALLOCS 1000
+
+int main(void) {
+  Region *region = my_region_create(4096);
+  CHECK_NULL(region);
+  char *ptrs[NALLOCS];
+  for (int i = 0; i < NALLOCS; i++) {
+    ptrs[i] = my_region_alloc(region, 1 + i % 100);
+    CHECK_NULL(ptrs[i]);
+    assert(((size_t)ptrs[i] & (kAlignment - 1)) == 0);
+    memset(ptrs[i], i, 1 + i % 100);
+  }
+  for (int i = 0; i < NALLOCS; i++)
+    for (int j = 0; j < 1 + i % 100; j++)
+      assert(ptrs[i][j] == (char)i);
+
+  char *big = my_region_alloc(region, 100000);
+  CHECK_NULL(big);
+  memset(big, 1, 100000);
+  assert(my_region_alloc(region, 0) == NULL);
+
+  // The same sizes after a reset land in the same chunks
+  my_region_reset(region);
+  for (int i = 0; i < NALLOCS; i++)
+    assert(my_region_alloc(region, 1 + i % 100) == ptrs[i]);
+  my_region_destroy(region);
+
+  // A second region is independent of the first
+  Region *a = my_region_create(0), *b = my_region_create(0);
+  CHECK_NULL(a);
+  CHECK_NULL(b);
+  int *x = my_region_alloc(a, sizeof(int)), *y = my_region_alloc(b, sizeof(int));
+  *x = 1;
+  *y = 2;
+  my_region_reset(b);
+  assert(*x == 1);
+  my_region_destroy(a);
+  my_region_destroy(b);
+
+#ifdef REGION_GUARD
+  region = my_region_create(0);
+  void *ptr = my_region_alloc(region, 64);
+  my_free(ptr);
+  assert(my_region_alloc(region, 64) == (char *)ptr + 64 + sizeof(size_t));
+  my_region_destroy(region);
+#endif
+  return 0;
+}
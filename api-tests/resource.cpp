@@ -0,0 +1,95 @@
+#include "../src/my_allocator.hpp"
+#include <cassert>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+/**
+ * This test checks the C++ adaptors bound to one heap or region (make api):
+ * containers on them leave the default heap alone, keep over-aligned types
+ * aligned, and allocators / resources compare equal only over the same heap
+ * or region.
+ **/
+
+struct alignas(64) Line {
+  char bytes[64];
+};
+
+static bool is_aligned(const void *ptr, std::size_t alignment) {
+  return (reinterpret_cast<std::uintptr_t>(ptr) & (alignment - 1)) == 0;
+}
+
+int main() {
+  HeapStats before, after;
+  my_malloc(1);
+  my_heap_get_stats(&before);
+
+  Heap *heap = my_heap_create(), *other = my_heap_create();
+  assert(heap && other);
+  {
+    my_heap_allocator<int> alloc(heap);
+    std::vector<int, my_heap_allocator<int>> ints(alloc);
+    for (int i = 0; i < 10000; i++)
+      ints.push_back(i);
+    assert(ints[9999] == 9999);
+    std::vector<Line, my_heap_allocator<Line>> lines(100, Line(), my_heap_allocator<Line>(heap));
+    assert(is_aligned(lines.data(), alignof(Line)));
+    assert(alloc == my_heap_allocator<Line>(heap));
+    assert(alloc != my_heap_allocator<int>(other));
+
+    my_heap_memory_resource resource(heap), same(heap), different(other);
+    assert(resource.is_equal(same) && !resource.is_equal(different));
+    std::pmr::map<int, int> map(&resource);
+    for (int i = 0; i < 1000; i++)
+      map[i] = -i;
+    assert(map.rbegin()->second == -999);
+    for (std::size_t alignment = 16; alignment <= 4096; alignment <<= 1) {
+      void *ptr = resource.allocate(100, alignment);
+      assert(is_aligned(ptr, alignment));
+      resource.deallocate(ptr, 100, alignment);
+    }
+  }
+  my_heap_destroy(heap);
+  my_heap_destroy(other);
+
+  // A static heap works the same, and runs out with bad_alloc
+  static char buf[1 << 16];
+  Heap *fixed = my_heap_init_static(buf, sizeof(buf));
+  assert(fixed);
+  my_heap_memory_resource fixed_resource(fixed);
+  std::pmr::vector<char> bytes(&fixed_resource);
+  bool threw = false;
+  try {
+    bytes.resize(1 << 17);
+  } catch (const std::bad_alloc &) {
+    threw = true;
+  }
+  assert(threw);
+
+  // Region: deallocation is a no-op, reset hands the memory out again
+  Region *region = my_region_create(0);
+  assert(region);
+  {
+    my_region_resource resource(region), same(region);
+    assert(resource.is_equal(same) && !resource.is_equal(fixed_resource));
+    std::pmr::vector<std::pmr::vector<int>> nested(&resource);
+    for (int i = 0; i < 100; i++)
+      nested.emplace_back(i, i);
+    assert(nested[99].size() == 99 && nested[99][98] == 99);
+    void *ptrs[9];
+    my_region_reset(region);
+    for (int i = 0; i < 9; i++) {
+      ptrs[i] = resource.allocate(24, std::size_t(16) << i);
+      assert(is_aligned(ptrs[i], std::size_t(16) << i));
+    }
+    my_region_reset(region);
+    for (int i = 0; i < 9; i++)
+      assert(resource.allocate(24, std::size_t(16) << i) == ptrs[i]);
+  }
+  my_region_destroy(region);
+
+  // Only the region's chunks came from the default heap, and went back
+  my_heap_get_stats(&after);
+  assert(after.allocated_blocks == before.allocated_blocks);
+  return 0;
+}
@@ -0,0 +1,56 @@
+#include "../tests/testing.h"
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * This test checks a heap over a caller's buffer: every block lies in the
+ * buffer, allocation fails rather than growing once it is full, and freeing
+ * everything makes the whole buffer available again.
+ **/
+
+#define BUFFER_SIZE (1 << 20)
+#define MAX_ALLOCS 100000
+
+static char buffer[BUFFER_SIZE + 3];
+static void *ptrs[MAX_ALLOCS];
+
+static int in_buffer(void *ptr, size_t size) {
+  return (char *)ptr > buffer && (char *)ptr + size <= buffer + sizeof(buffer);
+}
+
+int main(void) {
+  assert(my_heap_init_static(buffer, 64) == NULL);
+  assert(my_heap_init_static(NULL, BUFFER_SIZE) == NULL);
+
+  // Misaligned on purpose
+  Heap *heap = my_heap_init_static(buffer + 3, BUFFER_SIZE);
+  CHECK_NULL(heap);
+  assert(in_buffer(heap, 1));
+
+  size_t count = 0, live = 0;
+  for (; count < MAX_ALLOCS; count++) {
+    size_t size = 1 + count % 500;
+    ptrs[count] = my_heap_malloc(heap, size);
+    if (ptrs[count] == NULL)
+      break;
+    assert(in_buffer(ptrs[count], size));
+    assert(((size_t)ptrs[count] & (kAlignment - 1)) == 0);
+    memset(ptrs[count], (int)count, size);
+    live += size;
+  }
+  assert(count < MAX_ALLOCS && live > BUFFER_SIZE / 2);
+  assert(my_heap_malloc(heap, BUFFER_SIZE) == NULL);
+
+  for (size_t i = 0; i < count; i += 2)
+    my_heap_free(heap, ptrs[i]);
+  for (size_t i = 1; i < count; i += 2) {
+    assert(((unsigned char *)ptrs[i])[0] == (unsigned char)i);
+    my_heap_free(heap, ptrs[i]);
+  }
+  // Everything coalesced back into one block
+  void *big = my_heap_malloc(heap, BUFFER_SIZE - 4096);
+  CHECK_NULL(big);
+  assert(in_buffer(big, BUFFER_SIZE - 4096));
+  my_heap_destroy(heap);
+  return 0;
+}
@@ -4,18 +4,45 @@
 
 import argparse
 from enum import Enum
+import json
 import math
 import os
 from pathlib import Path
+import shlex
 import signal
 import subprocess
-from typing import List, Tuple
+import sys
+from typing import Dict, List, Tuple
 import numpy as np
 import scipy.stats
 
 # 10 min timeout
 TIMEOUT = 600
 
+# Allocators compared by --matrix; glibc_shim forwards to the C library malloc
+MATRIX_VARIANTS = ["naive_solution", "metadata_reduction",
+                   "constant_time_coalesce", "mymalloc", "glibc_shim"]
+# (name, binary in bench/, arguments) run against each of them
+MATRIX_BENCHMARKS = [("size-16", "benchmark", []), ("size-256", "benchmark", ["256"]),
+                     ("footprint", "footprint", ["2310", "1000000"])]
+
+# Benchmarks selectable with --bench; the threaded ones need THREADSAFE=1
+STRESS_BENCHMARKS = ["larson", "xmalloc-test", "cache-scratch", "cache-thrash"]
+BENCHMARKS = ["benchmark", "footprint"] + STRESS_BENCHMARKS
+
+# Printed by the benchmarks under --perf, when the counter could be opened
+PERF_COUNTERS = ["cycles", "instructions", "ipc", "l1d_misses", "llc_misses",
+                 "dtlb_misses", "branch_misses"]
+
+# Metrics gated by --compare besides the time, and which way is better. Every
+# other metric is only recorded.
+HIGHER_IS_BETTER = ["ops_per_s", "mark_mb_per_s", "sweep_mb_per_s", "ipc"]
+LOWER_IS_BETTER = ["peak_rss_kb", "peak_overhead_ratio", "metadata_overhead",
+                   "fragmentation_mean", "pause_p50_ms", "pause_p99_ms", "pause_max_ms",
+                   "malloc_p50_ns", "malloc_p99_ns", "free_p50_ns", "free_p99_ns",
+                   "cycles", "instructions", "l1d_misses", "llc_misses", "dtlb_misses",
+                   "branch_misses"]
+
 # Stats for tests
 TOTAL_RUNS = 0
 TOTAL_FAILS = 0
@@ -35,7 +62,42 @@ def parse_args():
                         help="allocator name, default to \"mymalloc\"")
     parser.add_argument("-i", "--invocations", type=int, default=10,
                         help="number of invocations of the benchmark")
-    return parser.parse_args()
+    parser.add_argument("-b", "--bench", type=str, default="benchmark", choices=BENCHMARKS,
+                        help="benchmark in bench/ to run, default to \"benchmark\"")
+    parser.add_argument("-a", "--bench-args", type=str, default="",
+                        help="extra arguments of the benchmark, e.g. the workload generator "
+                             "options of bench/benchmark: \"-d bimodal:16:256:4096:65536:0.05 -t 1000\"")
+    parser.add_argument("-t", "--threads", type=int, default=4,
+                        help="threads of the larson, xmalloc-test and cache-* benchmarks")
+    parser.add_argument("-l", "--latency", action="store_true",
+                        help="time every call and report latency percentiles (-b benchmark only)")
+    parser.add_argument("-p", "--perf", action="store_true",
+                        help="collect hardware performance counters (perf_event_open)")
+    parser.add_argument("--json", type=str,
+                        help="write every sample of the run to this file, usable as a baseline")
+    parser.add_argument("--compare", type=str, metavar="BASELINE",
+                        help="compare against a --json file, exit 1 on a significant regression")
+    parser.add_argument("--alpha", type=float, default=0.05,
+                        help="significance level of --compare (one-sided Welch t-test)")
+    parser.add_argument("--threshold", type=float, default=0.05,
+                        help="smallest relative change --compare reports as a regression")
+    parser.add_argument("--matrix", action="store_true",
+                        help="benchmark every allocator variant and print a comparison table")
+    parser.add_argument("--variants", type=str, default=",".join(MATRIX_VARIANTS),
+                        help="comma separated allocators for --matrix")
+    parser.add_argument("--gc", action="store_true",
+                        help="run the GC benchmark suite (bench/gcsuite) against mygc")
+    parser.add_argument("-w", "--workloads", type=str, default="trees,lists,graph,arrays",
+                        help="comma separated GC suite workloads")
+    parser.add_argument("--scale", type=int, default=4,
+                        help="size of the GC suite workloads (0-8)")
+    parser.add_argument("--live-ratio", type=float, default=0.5,
+                        help="live fraction of the graph workload")
+    args = parser.parse_args()
+    # Only bench/benchmark times its calls
+    if args.latency and (args.bench != "benchmark" or args.matrix or args.gc):
+        parser.error("-l/--latency is only supported with -b benchmark")
+    return args
 
 
 def get_test_name(test: str) -> str:
@@ -138,12 +200,24 @@ def check_test(test: str, output: bytes, exit_code: SubprocessExit, path: Path):
             "UTF-8"), "exit_code": exit_code})
 
 
-def run_benchmark_once(path: str, cwd: Path, i: int) -> Tuple[bytes, float, SubprocessExit]:
+def parse_metrics(output: bytes) -> dict:
+    """Parses the "key value" lines printed by the benchmarks."""
+    metrics = {}
+    for line in output.decode("utf-8").splitlines():
+        key, _, value = line.partition(" ")
+        try:
+            metrics[key] = float(value)
+        except ValueError:
+            pass
+    return metrics
+
+
+def run_benchmark_once(path: str, cwd: Path, i: int, args: List[str] = []) -> Tuple[bytes, float, SubprocessExit]:
     try:
-        print(f"{bcolors.OKCYAN}Running {bcolors.BOLD}{get_test_name(path)} #{i} {bcolors.ENDC}",
+        print(f"{bcolors.OKCYAN}Running {bcolors.BOLD}{' '.join([get_test_name(path)] + args)} #{i} {bcolors.ENDC}",
               end='', flush=True)
         p = subprocess.run(
-            [path],
+            [path] + args,
             check=True,
             env=os.environ.copy(),
             stdout=subprocess.PIPE,
@@ -151,7 +225,8 @@ def run_benchmark_once(path: str, cwd: Path, i: int) -> Tuple[bytes, float, Subp
             timeout=TIMEOUT,
             cwd=cwd
         )
-        time = float(p.stdout.decode("utf-8").strip())
+        # The time comes first, optionally followed by "key value" lines
+        time = float(p.stdout.decode("utf-8").split()[0])
         print(f"{bcolors.OKGREEN}OK ({time:.3f}s){bcolors.ENDC}", flush=True)
         return p.stdout, time, SubprocessExit.Normal
     except subprocess.CalledProcessError as e:
@@ -176,13 +251,17 @@ def calc_mean_with_ci(x: List[float], confidence=0.95) -> Tuple[float, float]:
     return (m, h)
 
 
-def run_benchmark(path: str, invocations: int, cwd: Path):
+def run_benchmark(path: str, invocations: int, cwd: Path, latency: bool = False, args: List[str] = []) -> Dict[str, List[float]]:
     print(f"{bcolors.OKCYAN}Start benchmark with {bcolors.ENDC}{bcolors.OKCYAN}{bcolors.BOLD}{invocations}{bcolors.ENDC}{bcolors.OKCYAN} invocations.{bcolors.ENDC}", flush=True)
     times = []
+    latencies = {}
     for i in range(invocations):
-        out, time, exit_code = run_benchmark_once(path, cwd, i)
+        out, time, exit_code = run_benchmark_once(
+            path, cwd, i, ["-l"] + args if latency else args)
         if exit_code == SubprocessExit.Normal:
             times.append(time)
+            for key, value in parse_metrics(out).items():
+                latencies.setdefault(key, []).append(value)
         elif exit_code == SubprocessExit.Error:
             print(f"{bcolors.FAIL}FAIL{bcolors.ENDC}", flush=True)
         else:
@@ -197,6 +276,174 @@ def run_benchmark(path: str, invocations: int, cwd: Path):
     else:
         mean, err = calc_mean_with_ci(times)
         print(f"{bcolors.OKGREEN}Average Time: {bcolors.BOLD}{mean:.3f}s ±{err:.3f}{bcolors.ENDC}", flush=True)
+    if latency and len(times) > 0:
+        # Overall percentiles; the per-size ones are in the benchmark output
+        for op in ["malloc", "free"]:
+            for p in ["p50", "p99", "p999", "max"]:
+                key = f"{op}_{p}_ns"
+                mean, err = calc_mean_with_ci(latencies[key])
+                print(f"  {key:<18} {mean:>12.1f} ±{err:.1f}", flush=True)
+    if len(times) > 0:
+        for key, values in latencies.items():
+            if latency and key not in PERF_COUNTERS:
+                continue
+            mean, err = calc_mean_with_ci(values)
+            print(f"  {key:<24} {mean:>14.6g} ±{err:.3g}", flush=True)
+    return {"time": times, **latencies}
+
+
+def run_gc_suite_once(cmd: List[str], cwd: Path, i: int) -> Tuple[dict, SubprocessExit]:
+    try:
+        print(f"{bcolors.OKCYAN}Running {bcolors.BOLD}{' '.join([get_test_name(cmd[0])] + cmd[1:])} #{i} {bcolors.ENDC}",
+              end='', flush=True)
+        p = subprocess.run(
+            cmd,
+            check=True,
+            env=os.environ.copy(),
+            stdout=subprocess.PIPE,
+            stderr=subprocess.STDOUT,
+            timeout=TIMEOUT,
+            cwd=cwd
+        )
+        metrics = parse_metrics(p.stdout)
+        print(f"{bcolors.OKGREEN}OK ({metrics['total_s']:.3f}s){bcolors.ENDC}", flush=True)
+        return metrics, SubprocessExit.Normal
+    except subprocess.CalledProcessError as e:
+        print(f"{bcolors.FAIL}FAIL{bcolors.ENDC}", flush=True)
+        return {}, SubprocessExit.Error
+    except subprocess.TimeoutExpired as e:
+        print(f"{bcolors.WARNING}TIMEOUT{bcolors.ENDC}", flush=True)
+        return {}, SubprocessExit.Timeout
+
+
+def run_gc_suite(args, cwd: Path) -> Dict[str, Dict[str, List[float]]]:
+    results = {}
+    for workload in args.workloads.split(","):
+        cmd = [f"{cwd}/bench/gcsuite", workload,
+               str(args.scale), str(args.live_ratio)]
+        runs = []
+        for i in range(args.invocations):
+            metrics, exit_code = run_gc_suite_once(cmd, cwd, i)
+            if exit_code == SubprocessExit.Normal:
+                runs.append(metrics)
+        print(f"{bcolors.OKGREEN}{bcolors.BOLD}{workload}{bcolors.ENDC}{bcolors.OKGREEN} ({len(runs)} / {args.invocations} invocations){bcolors.ENDC}", flush=True)
+        if len(runs) == 0:
+            continue
+        samples = {key: [run[key] for run in runs if key in run] for key in runs[0]}
+        for key, values in samples.items():
+            mean, err = calc_mean_with_ci(values)
+            print(f"  {key:<24} {mean:>12.3f} ±{err:.3f}", flush=True)
+        results[workload] = {"time": samples["total_s"], **samples}
+    return results
+
+
+def run_matrix(args, cwd: Path) -> Dict[str, Dict[str, List[float]]]:
+    results = []
+    samples = {}
+    for variant in args.variants.split(","):
+        build_cmd = f"MALLOC={variant} RELEASE=1"
+        output, exit_code = make("clean", cwd)
+        check_make("clean", output, exit_code)
+        output, exit_code = make(f"bench {build_cmd}", cwd)
+        check_make(f"bench {build_cmd}", output, exit_code)
+        for name, binary, bench_args in MATRIX_BENCHMARKS:
+            times, rss, overhead, frag = [], [], [], []
+            metric_samples = {}
+            for i in range(args.invocations):
+                out, time, exit_code = run_benchmark_once(
+                    f"{cwd}/bench/{binary}", cwd, i, bench_args)
+                if exit_code != SubprocessExit.Normal:
+                    print(f"{bcolors.FAIL}FAIL{bcolors.ENDC}", flush=True)
+                    continue
+                metrics = parse_metrics(out)
+                for key, value in metrics.items():
+                    metric_samples.setdefault(key, []).append(value)
+                heap_kb = metrics["peak_rss_kb"] - metrics["baseline_rss_kb"]
+                live_kb = metrics["peak_live_bytes"] / 1024
+                times.append(time)
+                rss.append(metrics["peak_rss_kb"] / 1024)
+                # Share of the resident memory grown since start-up not holding
+                # live data: page granularity and the allocator's own
+                # mappings included, so not a measure of fragmentation
+                overhead.append(max(0.0, 1 - live_kb / heap_kb) if heap_kb > 0 else 0.0)
+                # Free space between blocks, from footprint's heap walk
+                if "fragmentation_mean" in metrics:
+                    frag.append(metrics["fragmentation_mean"])
+            results.append((variant, name, times, rss, overhead, frag))
+            samples[f"{variant}/{name}"] = {"time": times, **metric_samples}
+    output, exit_code = make("clean", cwd)
+    check_make("clean", output, exit_code)
+
+    print(f"\n{bcolors.BOLD}{'variant':<24} {'benchmark':<16} {'time (s)':>18} {'peak RSS (MB)':>16} {'RSS overhead':>13} {'fragmentation':>14}{bcolors.ENDC}")
+    for variant, name, times, rss, overhead, frag in results:
+        if len(times) == 0:
+            print(f"{variant:<24} {name:<16} {bcolors.FAIL}{'FAIL':>18}{bcolors.ENDC}")
+            continue
+        mean, err = calc_mean_with_ci(times)
+        # Only allocators with the heap-walk helpers report fragmentation
+        frag_col = f"{100 * np.mean(frag):>13.1f}%" if frag else f"{'-':>14}"
+        print(f"{variant:<24} {name:<16} {mean:>10.3f} ±{err:<6.3f} {max(rss):>16.1f} {100 * np.mean(overhead):>12.1f}% {frag_col}")
+    return samples
+
+
+def write_json(path: str, args, results: Dict[str, Dict[str, List[float]]]):
+    """Writes the raw samples of every benchmark, keyed by benchmark then metric."""
+    config = {key: value for key, value in vars(args).items()
+              if key not in ["json", "compare"]}
+    with open(path, "w") as f:
+        json.dump({"config": config, "results": results}, f, indent=2)
+    print(f"{bcolors.OKCYAN}Results written to {path}{bcolors.ENDC}", flush=True)
+
+
+def compare_results(baseline_path: str, results: Dict[str, Dict[str, List[float]]],
+                    alpha: float, threshold: float) -> int:
+    """Compares the run against a baseline written by --json. A metric regresses
+    when it moved the wrong way by more than threshold (relative) and a
+    one-sided Welch t-test rejects "no change" at level alpha. Returns the
+    number of regressions."""
+    with open(baseline_path) as f:
+        baseline = json.load(f)["results"]
+    regressions = 0
+    print(f"\n{bcolors.BOLD}{'benchmark':<32} {'metric':<20} {'baseline':>14} {'current':>14} {'change':>9} {'p':>8}{bcolors.ENDC}")
+    for name, metrics in results.items():
+        if name not in baseline:
+            continue
+        for key, values in metrics.items():
+            if key == "time" or key in LOWER_IS_BETTER:
+                sign = 1
+            elif key in HIGHER_IS_BETTER:
+                sign = -1
+            else:
+                continue
+            old = baseline[name].get(key, [])
+            if len(values) < 2 or len(old) < 2:
+                continue
+            old_mean, new_mean = np.mean(old), np.mean(values)
+            change = (new_mean - old_mean) / old_mean if old_mean != 0 else 0.0
+            if np.std(old) == 0 and np.std(values) == 0:
+                p = 0.0 if new_mean != old_mean else 1.0
+            else:
+                _, p = scipy.stats.ttest_ind(values, old, equal_var=False)
+                # One-sided: half the two-sided p-value when the mean moved the
+                # wrong way
+                p = p / 2 if sign * (new_mean - old_mean) > 0 else 1 - p / 2
+            regressed = p < alpha and sign * change > threshold
+            regressions += regressed
+            colour = bcolors.FAIL if regressed else (
+                bcolors.OKGREEN if sign * change < -threshold and p > 1 - alpha else "")
+            print(f"{colour}{name:<32} {key:<20} {old_mean:>14.6g} {new_mean:>14.6g} {100 * change:>+8.1f}% {p:>8.3f}{bcolors.ENDC}")
+    if regressions:
+        print(f"{bcolors.FAIL}{regressions} significant regression(s) against {baseline_path}{bcolors.ENDC}", flush=True)
+    else:
+        print(f"{bcolors.OKGREEN}No significant regression against {baseline_path}{bcolors.ENDC}", flush=True)
+    return regressions
+
+
+def report(args, results: Dict[str, Dict[str, List[float]]]):
+    if args.json:
+        write_json(args.json, args, results)
+    if args.compare and compare_results(args.compare, results, args.alpha, args.threshold):
+        sys.exit(1)
 
 
 def main():
@@ -204,21 +451,45 @@ def main():
 
     script_path = os.path.realpath(__file__)
     script_path = Path(script_path).parent.absolute()
+    if args.perf:
+        # Read by bench/perf_counters.h; counters that cannot be opened are
+        # simply missing from the output
+        os.environ["BENCH_PERF"] = "1"
+    if args.matrix:
+        report(args, run_matrix(args, script_path))
+        return
     # Clean
     output, exit_code = make("clean", script_path)
     check_make("clean", output, exit_code)
+    if args.gc:
+        args.malloc = "mygc"
     # Build malloc
     build_cmd = f"MALLOC={args.malloc} " if args.malloc is not None else ""
     build_cmd += "RELEASE=1 "
+    if args.bench in STRESS_BENCHMARKS:
+        build_cmd += "THREADSAFE=1 "
     output, exit_code = make(build_cmd, script_path)
     check_make(build_cmd, output, exit_code)
+    if args.gc:
+        output, exit_code = make(f"gcsuite " + build_cmd, script_path)
+        check_make(f"gcsuite", output, exit_code)
+        report(args, run_gc_suite(args, script_path))
+        return
     # Build benchmarks
+    target = "stress" if args.bench in STRESS_BENCHMARKS else "bench"
     output, exit_code = make(
-        f"bench " + build_cmd, script_path)
-    check_make(f"bench", output, exit_code)
+        f"{target} " + build_cmd, script_path)
+    check_make(target, output, exit_code)
     # Run
-    run_benchmark(
-        f"{script_path}/bench/benchmark", args.invocations, script_path)
+    bench_args = []
+    if args.bench == "xmalloc-test":
+        bench_args = [str(max(1, args.threads // 2))] * 2
+    elif args.bench in STRESS_BENCHMARKS:
+        bench_args = [str(args.threads)]
+    bench_args += shlex.split(args.bench_args)
+    results = run_benchmark(
+        f"{script_path}/bench/{args.bench}", args.invocations, script_path, args.latency, bench_args)
+    report(args, {" ".join([args.bench] + bench_args): results})
 
 
 class bcolors:
@@ -14,29 +14,246 @@
    <https://www.gnu.org/licenses/>.  */
 
 #include "../tests/testing.h"
+#include "perf_counters.h"
+#include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/resource.h>
 #include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 /* Benchmark the malloc/free performance of a varying number of blocks of a
-   given size. */
+   given size. The first line of output is the time taken; the "key value"
+   lines after it let bench.py --matrix compare memory use. With -l every
+   call is timed on its own and latency percentiles are reported as well.
+   With $BENCH_PERF set, hardware counters over the timed loop follow.
+   The options of the workload generator below replace the fixed sizes with
+   size and lifetime distributions. */
 
 #define NUM_ITERS 300
 #define NUM_ALLOCS 4
 #define MAX_ALLOCS 200
 
+// Most bytes requested and not yet freed at any point
+static size_t peak_live_bytes = 0;
+
+/* ============================ Latency histograms ============================
+
+   Log-bucketed like HdrHistogram: values below HIST_SUB_BUCKETS get a bucket
+   each, above that every power of two is split into HIST_SUB_BUCKETS buckets,
+   so a reported percentile is within 1 / HIST_SUB_BUCKETS of the truth. */
+
+#define HIST_SUB_BITS 4
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
+// Distinct block sizes reported separately (bench() is run with 9, the
+// workload generator uses power-of-two size classes)
+#define MAX_SIZES 32
+
+typedef struct {
+  uint64_t counts[HIST_BUCKETS];
+  uint64_t total;
+  uint64_t max;
+} histogram;
+
+enum { OP_MALLOC, OP_FREE, NUM_OPS };
+static const char *op_names[NUM_OPS] = {"malloc", "free"};
+
+static int latency_mode = 0;
+static histogram op_hist[NUM_OPS];
+static histogram size_hist[NUM_OPS][MAX_SIZES];
+static size_t hist_sizes[MAX_SIZES];
+static int n_hist_sizes = 0;
+// Bucket sizes by power of two rather than exact size (workload generator)
+static int hist_size_classes = 0;
+// Cost of an empty timed section, and timer ticks per nanosecond
+static uint64_t timer_overhead = 0;
+static double ticks_per_ns = 1.0;
+
+static inline int hist_bucket(uint64_t value) {
+  if (value < HIST_SUB_BUCKETS)
+    return (int)value;
+  int shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+  return (shift + 1) * HIST_SUB_BUCKETS + (int)((value >> shift) & (HIST_SUB_BUCKETS - 1));
+}
+
+// Smallest value falling in the bucket's successor, i.e. its upper bound
+static uint64_t hist_bucket_limit(int bucket) {
+  if (bucket < HIST_SUB_BUCKETS)
+    return bucket;
+  int shift = bucket / HIST_SUB_BUCKETS - 1;
+  uint64_t sub = HIST_SUB_BUCKETS + bucket % HIST_SUB_BUCKETS;
+  return ((sub + 1) << shift) - 1;
+}
+
+static inline void hist_record(histogram *hist, uint64_t value) {
+  hist->counts[hist_bucket(value)]++;
+  hist->total++;
+  if (value > hist->max)
+    hist->max = value;
+}
+
+static uint64_t hist_percentile(const histogram *hist, double p) {
+  uint64_t rank = (uint64_t)(p * hist->total + 0.5), seen = 0;
+  for (int i = 0; i < HIST_BUCKETS; i++) {
+    seen += hist->counts[i];
+    if (seen >= rank && seen > 0)
+      return hist_bucket_limit(i) < hist->max ? hist_bucket_limit(i) : hist->max;
+  }
+  return hist->max;
+}
+
+/* rdtsc where available (fenced so the timed call cannot move across it),
+   CLOCK_MONOTONIC_RAW nanoseconds elsewhere. */
+static inline uint64_t timer_start(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  _mm_lfence();
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+static inline uint64_t timer_stop(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned int aux;
+  uint64_t ticks = __rdtscp(&aux);
+  _mm_lfence();
+  return ticks;
+#else
+  return timer_start();
+#endif
+}
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+// Measures the timer's rate against CLOCK_MONOTONIC_RAW and the median cost
+// of an empty timed section, which is subtracted from every sample
+static void timer_calibrate(void) {
+  static uint64_t empty[10001];
+  for (size_t i = 0; i < sizeof(empty) / sizeof(empty[0]); i++) {
+    uint64_t start = timer_start();
+    empty[i] = timer_stop() - start;
+  }
+  qsort(empty, sizeof(empty) / sizeof(empty[0]), sizeof(uint64_t), cmp_u64);
+  timer_overhead = empty[sizeof(empty) / sizeof(empty[0]) / 2];
+
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &t0);
+  uint64_t start = timer_start();
+  usleep(20000);
+  uint64_t ticks = timer_stop() - start;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &t1);
+  double ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+  ticks_per_ns = ticks / ns;
+}
+
+static histogram *size_histogram(int op, size_t size) {
+  if (hist_size_classes) {
+    size_t bucket = 1;
+    while (bucket < size)
+      bucket <<= 1;
+    size = bucket;
+  }
+  for (int i = 0; i < n_hist_sizes; i++)
+    if (hist_sizes[i] == size)
+      return &size_hist[op][i];
+  if (n_hist_sizes == MAX_SIZES)
+    return NULL;
+  hist_sizes[n_hist_sizes] = size;
+  return &size_hist[op][n_hist_sizes++];
+}
+
+static inline void record_latency(int op, size_t size, uint64_t ticks) {
+  ticks = ticks > timer_overhead ? ticks - timer_overhead : 0;
+  hist_record(&op_hist[op], ticks);
+  histogram *hist = size_histogram(op, size);
+  if (hist != NULL)
+    hist_record(hist, ticks);
+}
+
+static void *timed_malloc(size_t size) {
+  uint64_t start = timer_start();
+  void *ptr = my_malloc(size);
+  record_latency(OP_MALLOC, size, timer_stop() - start);
+  CHECK_NULL(ptr);
+  return ptr;
+}
+
+static void timed_free(void *ptr, size_t size) {
+  uint64_t start = timer_start();
+  my_free(ptr);
+  record_latency(OP_FREE, size, timer_stop() - start);
+}
+
+static void print_histogram(const char *name, const histogram *hist) {
+  static const struct {
+    const char *suffix;
+    double p;
+  } percentiles[] = {{"p50", 0.50}, {"p99", 0.99}, {"p999", 0.999}};
+  for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++)
+    printf("%s_%s_ns %.1f\n", name, percentiles[i].suffix,
+           hist_percentile(hist, percentiles[i].p) / ticks_per_ns);
+  printf("%s_max_ns %.1f\n", name, hist->max / ticks_per_ns);
+}
+
+static void print_latencies(void) {
+  char name[64];
+  printf("timer_overhead_ns %.1f\n", timer_overhead / ticks_per_ns);
+  for (int op = 0; op < NUM_OPS; op++) {
+    printf("%s_calls %llu\n", op_names[op], (unsigned long long)op_hist[op].total);
+    print_histogram(op_names[op], &op_hist[op]);
+    for (int i = 0; i < n_hist_sizes; i++) {
+      snprintf(name, sizeof(name), "%s_%zu", op_names[op], hist_sizes[i]);
+      print_histogram(name, &size_hist[op][i]);
+    }
+  }
+}
+
 typedef struct {
   size_t iters;
   size_t size;
   int n;
 } malloc_args;
 
+// Same work as do_benchmark, each call timed
+static void do_latency_benchmark(malloc_args *args, char **arr) {
+  size_t size = args->size;
+  int n = args->n;
+
+  for (int j = 0; j < args->iters; j++) {
+    for (int i = 0; i < n; i++) {
+      arr[i] = timed_malloc(size);
+      memset(arr[i], i, size);
+    }
+    if (n * size > peak_live_bytes)
+      peak_live_bytes = n * size;
+    for (int i = 0; i < n / 2; i++)
+      timed_free(arr[i], size);
+    for (int i = n - 1; i >= n / 2; i--)
+      timed_free(arr[i], size);
+  }
+}
+
 static void do_benchmark(malloc_args *args, char **arr) {
   size_t iters = args->iters;
   size_t size = args->size;
   int n = args->n;
 
+  if (latency_mode) {
+    do_latency_benchmark(args, arr);
+    return;
+  }
   for (int j = 0; j < iters; j++) {
     for (int i = 0; i < n; i++) {
       arr[i] = mallocing(size);
@@ -44,6 +261,8 @@ static void do_benchmark(malloc_args *args, char **arr) {
         arr[i][g] = (char)g;
       }
     }
+    if (n * size > peak_live_bytes)
+      peak_live_bytes = n * size;
 
     // free half in fifo order
     for (int i = 0; i < n / 2; i++) {
@@ -80,21 +299,404 @@ void bench(unsigned long size) {
   freeing(arr);
 }
 
+/* ============================ Workload generator ============================
+
+   Selected by any of -d, -t, -w, -o, -n: instead of the fixed multiples of
+   one size, n blocks are allocated with sizes drawn from a distribution
+   (-d). Each block lives for a number of later allocations drawn from a
+   lifetime distribution (-t: exponential, fixed, uniform or a bimodal mix of
+   short- and long-lived exponentials); without one, blocks live until the
+   working set (-w blocks) is full and are then freed in fifo, lifo or random
+   order (-o). With -t a full working set frees the block closest to its
+   death. */
+
+// Rows of a size histogram file
+#define MAX_HIST_ROWS 1024
+
+typedef enum { DIST_UNIFORM, DIST_POWERLAW, DIST_BIMODAL, DIST_FILE } size_dist_kind;
+typedef enum { ORDER_FIFO, ORDER_LIFO, ORDER_RANDOM } free_order;
+typedef enum { LIFE_NONE, LIFE_EXP, LIFE_FIXED, LIFE_UNIFORM, LIFE_BIMODAL } lifetime_kind;
+
+typedef struct {
+  size_dist_kind kind;
+  size_t min, max;
+  // Power law exponent, or share of large blocks (bimodal)
+  double param;
+  // Large mode of the bimodal distribution
+  size_t large_min, large_max;
+  // Histogram rows and cumulative weights (file)
+  size_t sizes[MAX_HIST_ROWS];
+  double cumulative[MAX_HIST_ROWS];
+  int rows;
+} size_dist;
+
+typedef struct {
+  lifetime_kind kind;
+  // Mean (exp), length (fixed), bounds (uniform) or short and long means
+  // (bimodal), in allocations
+  double a, b;
+  // Share of long-lived blocks (bimodal)
+  double p_long;
+} lifetime_dist;
+
+typedef struct {
+  void *ptr;
+  size_t size;
+  // Allocation count at which the block is freed (lifetime mode)
+  uint64_t death;
+} live_block;
+
+typedef struct {
+  int enabled;
+  size_dist sizes;
+  lifetime_dist lifetime;
+  size_t working_set;
+  free_order order;
+  uint64_t allocations;
+  uint64_t seed;
+} workload;
+
+static workload gen = {
+    .sizes = {.kind = DIST_UNIFORM, .min = 16, .max = 256},
+    .working_set = 10000,
+    .order = ORDER_FIFO,
+    .allocations = 10000000,
+    .seed = 2310,
+};
+
+static uint64_t rng_state;
+
+// xorshift64*: cheap enough not to show up next to my_malloc
+static inline uint64_t rng_next(void) {
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return rng_state * 0x2545F4914F6CDD1Dull;
+}
+
+// Uniform in [0, 1)
+static inline double rng_double(void) {
+  return (rng_next() >> 11) * (1.0 / (1ull << 53));
+}
+
+static inline size_t rng_range(size_t min, size_t max) {
+  return min + rng_next() % (max - min + 1);
+}
+
+static size_t sample_size(const size_dist *dist) {
+  switch (dist->kind) {
+  case DIST_UNIFORM:
+    return rng_range(dist->min, dist->max);
+  case DIST_POWERLAW: {
+    // Inverse CDF of p(x) ~ x^-alpha bounded to [min, max]
+    double u = rng_double(), a = 1 - dist->param;
+    if (fabs(a) < 1e-9)
+      return (size_t)(dist->min * pow((double)dist->max / dist->min, u));
+    double lo = pow(dist->min, a), hi = pow(dist->max, a);
+    return (size_t)pow(lo + u * (hi - lo), 1 / a);
+  }
+  case DIST_BIMODAL:
+    if (rng_double() < dist->param)
+      return rng_range(dist->large_min, dist->large_max);
+    return rng_range(dist->min, dist->max);
+  case DIST_FILE: {
+    double u = rng_double() * dist->cumulative[dist->rows - 1];
+    int lo = 0, hi = dist->rows - 1;
+    while (lo < hi) {
+      int mid = (lo + hi) / 2;
+      if (dist->cumulative[mid] > u)
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+    return dist->sizes[lo];
+  }
+  }
+  return dist->min;
+}
+
+// "size weight" per line, '#' starts a comment
+static int load_histogram(size_dist *dist, const char *path) {
+  FILE *file = fopen(path, "r");
+  char line[256];
+  double total = 0;
+  if (file == NULL)
+    return 0;
+  dist->rows = 0;
+  while (fgets(line, sizeof(line), file) && dist->rows < MAX_HIST_ROWS) {
+    size_t size;
+    double weight;
+    if (line[0] == '#' || sscanf(line, "%zu %lf", &size, &weight) != 2 ||
+        size == 0 || weight <= 0)
+      continue;
+    total += weight;
+    dist->sizes[dist->rows] = size;
+    dist->cumulative[dist->rows++] = total;
+  }
+  fclose(file);
+  return dist->rows > 0;
+}
+
+static int parse_size_dist(size_dist *dist, const char *spec) {
+  if (strncmp(spec, "file:", 5) == 0) {
+    dist->kind = DIST_FILE;
+    return load_histogram(dist, spec + 5);
+  }
+  if (sscanf(spec, "uniform:%zu:%zu", &dist->min, &dist->max) == 2)
+    dist->kind = DIST_UNIFORM;
+  else if (sscanf(spec, "powerlaw:%zu:%zu:%lf", &dist->min, &dist->max, &dist->param) == 3)
+    dist->kind = DIST_POWERLAW;
+  else if (sscanf(spec, "bimodal:%zu:%zu:%zu:%zu:%lf", &dist->min, &dist->max,
+                  &dist->large_min, &dist->large_max, &dist->param) == 5)
+    dist->kind = DIST_BIMODAL;
+  else
+    return 0;
+  if (dist->kind == DIST_BIMODAL &&
+      (dist->large_min == 0 || dist->large_max < dist->large_min ||
+       dist->param < 0 || dist->param > 1))
+    return 0;
+  return dist->min > 0 && dist->max >= dist->min;
+}
+
+static inline uint64_t rng_exponential(double mean) {
+  return (uint64_t)(-log(1 - rng_double()) * mean);
+}
+
+// Allocations a block lives for, at least one
+static uint64_t sample_lifetime(const lifetime_dist *dist) {
+  switch (dist->kind) {
+  case LIFE_EXP:
+    return 1 + rng_exponential(dist->a);
+  case LIFE_FIXED:
+    return (uint64_t)dist->a;
+  case LIFE_UNIFORM:
+    return rng_range((size_t)dist->a, (size_t)dist->b);
+  case LIFE_BIMODAL:
+    return 1 + rng_exponential(rng_double() < dist->p_long ? dist->b : dist->a);
+  case LIFE_NONE:
+    break;
+  }
+  return 1;
+}
+
+// A bare number is the mean of an exponential lifetime
+static int parse_lifetime(lifetime_dist *dist, const char *spec) {
+  char *end;
+  dist->a = strtod(spec, &end);
+  if (end != spec && *end == '\0')
+    dist->kind = LIFE_EXP;
+  else if (sscanf(spec, "exp:%lf", &dist->a) == 1)
+    dist->kind = LIFE_EXP;
+  else if (sscanf(spec, "fixed:%lf", &dist->a) == 1)
+    dist->kind = LIFE_FIXED;
+  else if (sscanf(spec, "uniform:%lf:%lf", &dist->a, &dist->b) == 2)
+    dist->kind = LIFE_UNIFORM;
+  else if (sscanf(spec, "bimodal:%lf:%lf:%lf", &dist->a, &dist->b, &dist->p_long) == 3)
+    dist->kind = LIFE_BIMODAL;
+  else
+    return 0;
+  if ((dist->kind == LIFE_FIXED || dist->kind == LIFE_UNIFORM) && dist->a < 1)
+    return 0;
+  if (dist->kind == LIFE_UNIFORM && dist->b < dist->a)
+    return 0;
+  if (dist->kind == LIFE_BIMODAL && (dist->b <= 0 || dist->p_long < 0 || dist->p_long > 1))
+    return 0;
+  return dist->a > 0;
+}
+
+static int parse_order(free_order *order, const char *spec) {
+  if (strcmp(spec, "fifo") == 0)
+    *order = ORDER_FIFO;
+  else if (strcmp(spec, "lifo") == 0)
+    *order = ORDER_LIFO;
+  else if (strcmp(spec, "random") == 0)
+    *order = ORDER_RANDOM;
+  else
+    return 0;
+  return 1;
+}
+
+static void gen_malloc(live_block *block, size_t size) {
+  block->size = size;
+  block->ptr = latency_mode ? timed_malloc(size) : mallocing(size);
+  memset(block->ptr, (int)size, size);
+}
+
+static void gen_free(live_block *block) {
+  if (latency_mode)
+    timed_free(block->ptr, block->size);
+  else
+    freeing(block->ptr);
+}
+
+/* Min-heap on death time, for the lifetime mode */
+static void heap_push(live_block *heap, size_t *n, live_block block) {
+  size_t i = (*n)++;
+  while (i > 0 && heap[(i - 1) / 2].death > block.death) {
+    heap[i] = heap[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  heap[i] = block;
+}
+
+static live_block heap_pop(live_block *heap, size_t *n) {
+  live_block top = heap[0], last = heap[--*n];
+  size_t i = 0;
+  for (;;) {
+    size_t child = 2 * i + 1;
+    if (child >= *n)
+      break;
+    if (child + 1 < *n && heap[child + 1].death < heap[child].death)
+      child++;
+    if (heap[child].death >= last.death)
+      break;
+    heap[i] = heap[child];
+    i = child;
+  }
+  heap[i] = last;
+  return top;
+}
+
+static void run_workload(void) {
+  // Heap in lifetime mode, otherwise a ring (fifo), stack (lifo) or bag
+  // (random)
+  live_block *live = calloc(gen.working_set, sizeof(live_block));
+  size_t head = 0, n_live = 0, live_bytes = 0;
+  if (live == NULL) {
+    fprintf(stderr, "working set too large\n");
+    exit(1);
+  }
+  rng_state = gen.seed ? gen.seed : 1;
+  for (uint64_t now = 0; now < gen.allocations; now++) {
+    live_block block;
+    if (gen.lifetime.kind != LIFE_NONE) {
+      while (n_live > 0 && (live[0].death <= now || n_live == gen.working_set)) {
+        block = heap_pop(live, &n_live);
+        live_bytes -= block.size;
+        gen_free(&block);
+      }
+    } else if (n_live == gen.working_set) {
+      size_t victim;
+      if (gen.order == ORDER_FIFO)
+        victim = head, head = (head + 1) % gen.working_set;
+      else if (gen.order == ORDER_LIFO)
+        victim = n_live - 1;
+      else
+        victim = rng_next() % n_live;
+      live_bytes -= live[victim].size;
+      gen_free(&live[victim]);
+      n_live--;
+      // Keep the random bag dense; the fifo ring reuses the freed slot
+      if (gen.order == ORDER_RANDOM)
+        live[victim] = live[n_live];
+    }
+
+    size_t size = sample_size(&gen.sizes);
+    if (gen.lifetime.kind != LIFE_NONE) {
+      block.death = now + sample_lifetime(&gen.lifetime);
+      gen_malloc(&block, size);
+      heap_push(live, &n_live, block);
+    } else {
+      size_t slot = gen.order == ORDER_FIFO ? (head + n_live) % gen.working_set : n_live;
+      gen_malloc(&live[slot], size);
+      n_live++;
+    }
+    live_bytes += size;
+    if (live_bytes > peak_live_bytes)
+      peak_live_bytes = live_bytes;
+  }
+  for (size_t i = 0; i < n_live; i++)
+    gen_free(&live[gen.order == ORDER_FIFO && gen.lifetime.kind == LIFE_NONE
+                       ? (head + i) % gen.working_set
+                       : i]);
+  free(live);
+}
+
 static void usage(const char *name) {
-  fprintf(stderr, "%s: <alloc_size>\n", name);
+  fprintf(stderr, "%s: [-l] <alloc_size>\n", name);
+  fprintf(stderr, "%s: [-l] [-d dist] [-t lifetime] [-w working_set] [-o order] [-n allocations] [-s seed]\n", name);
+  fprintf(stderr, "  -l  time every call and report latency percentiles\n");
+  fprintf(stderr, "  -d  uniform:MIN:MAX, powerlaw:MIN:MAX:ALPHA,\n"
+                  "      bimodal:MIN:MAX:LARGE_MIN:LARGE_MAX:P_LARGE or file:PATH\n"
+                  "      (\"size weight\" lines)\n");
+  fprintf(stderr, "  -t  lifetime in allocations: MEAN or exp:MEAN (exponential), fixed:N,\n"
+                  "      uniform:MIN:MAX or bimodal:SHORT_MEAN:LONG_MEAN:P_LONG\n"
+                  "      (exponentials; default: none)\n");
+  fprintf(stderr, "  -w  most live blocks (default 10000)\n");
+  fprintf(stderr, "  -o  fifo, lifo or random: blocks freed when the working set is full\n");
+  fprintf(stderr, "  -n  blocks allocated (default 10000000)\n");
   exit(1);
 }
 
+// Peak resident set. VmHWM rather than ru_maxrss where available: the latter
+// survives execve, so it reports the parent's RSS when that was larger.
+static long max_rss_kb(void) {
+  FILE *status = fopen("/proc/self/status", "r");
+  if (status != NULL) {
+    char line[256];
+    long kb = -1;
+    while (kb < 0 && fgets(line, sizeof(line), status))
+      sscanf(line, "VmHWM: %ld kB", &kb);
+    fclose(status);
+    if (kb >= 0)
+      return kb;
+  }
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
 int main(int argc, char **argv) {
-  clock_t start_t = clock();
+  long baseline_rss_kb = max_rss_kb();
+  int opt;
+  while ((opt = getopt(argc, argv, "ld:t:w:o:n:s:")) != -1) {
+    int ok = 1;
+    if (opt != 'l')
+      gen.enabled = 1;
+    switch (opt) {
+    case 'l':
+      latency_mode = 1;
+      break;
+    case 'd':
+      ok = parse_size_dist(&gen.sizes, optarg);
+      break;
+    case 't':
+      ok = parse_lifetime(&gen.lifetime, optarg);
+      break;
+    case 'w':
+      gen.working_set = strtoul(optarg, NULL, 0);
+      ok = gen.working_set > 0;
+      break;
+    case 'o':
+      ok = parse_order(&gen.order, optarg);
+      break;
+    case 'n':
+      gen.allocations = strtoull(optarg, NULL, 0);
+      break;
+    case 's':
+      gen.seed = strtoull(optarg, NULL, 0);
+      break;
+    default:
+      ok = 0;
+    }
+    if (!ok)
+      usage(argv[0]);
+  }
   long size = 16;
-  if (argc == 2)
-    size = strtol(argv[1], NULL, 0);
+  if (optind + 1 == argc)
+    size = strtol(argv[optind], NULL, 0);
 
-  if (argc > 2 || size <= 0)
+  if (argc > optind + 1 || size <= 0 || (gen.enabled && optind != argc))
     usage(argv[0]);
+  hist_size_classes = gen.enabled;
+  if (latency_mode)
+    timer_calibrate();
 
-  for (int i = 0; i < 100; i++) {
+  perf_counters counters;
+  perf_counters_open(&counters);
+  perf_counters_start(&counters);
+  clock_t start_t = clock();
+  for (int i = 0; i < 100 && !gen.enabled; i++) {
     bench(size);
     bench(2 * size);
     bench(4 * size);
@@ -105,8 +707,23 @@ int main(int argc, char **argv) {
     bench(14 * size);
     bench(16 * size);
   }
+  if (gen.enabled)
+    run_workload();
   clock_t end_t = clock();
+  perf_counters_stop(&counters);
   double time_taken = (double)(end_t - start_t) / CLOCKS_PER_SEC;
   printf("%f\n", time_taken);
+  // The fixed-size runs keep their table of blocks in the allocator, the
+  // generator's comes from libc and is reported on its own
+  if (gen.enabled) {
+    printf("peak_live_bytes %zu\n", peak_live_bytes);
+    printf("table_bytes %zu\n", gen.working_set * sizeof(live_block));
+  } else
+    printf("peak_live_bytes %zu\n", peak_live_bytes + MAX_ALLOCS * sizeof(void *));
+  printf("baseline_rss_kb %ld\n", baseline_rss_kb);
+  printf("peak_rss_kb %ld\n", max_rss_kb());
+  perf_counters_print(&counters);
+  if (latency_mode)
+    print_latencies();
   return 0;
 }
@@ -0,0 +1,109 @@
+#include "../tests/testing.h"
+#include "perf_counters.h"
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+/* Port of cache-scratch (Berger et al., Hoard). Passive false sharing: the
+   main thread allocates one small object per thread, all likely on the same
+   cache lines, and hands them out. Each thread frees its object, then
+   repeatedly allocates an object, writes every byte of it and frees it. An
+   allocator that gives the freed memory back to the thread that freed it makes
+   the threads write to each other's cache lines, and the run does not scale.
+
+   Build the allocator with THREADSAFE=1. The first line of output is the wall
+   time, "key value" lines follow; false_sharing_threads counts the threads
+   whose first object shared a cache line with another thread's. */
+
+#define CACHE_LINE 64
+
+typedef struct {
+  char *inherited;
+  // Address of the first object the thread allocated itself
+  char *first;
+} Worker;
+
+static long iterations = 100000;
+static size_t obj_size = 8;
+static long repetitions = 50;
+
+static double now_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *run_worker(void *arg) {
+  Worker *worker = arg;
+  my_free(worker->inherited);
+  for (long i = 0; i < iterations; i++) {
+    volatile char *obj = my_malloc(obj_size);
+    CHECK_NULL(obj);
+    if (i == 0)
+      worker->first = (char *)obj;
+    for (long r = 0; r < repetitions; r++)
+      for (size_t j = 0; j < obj_size; j++)
+        obj[j]++;
+    my_free((void *)obj);
+  }
+  return NULL;
+}
+
+static long false_sharing_threads(Worker *workers, long threads) {
+  long count = 0;
+  for (long a = 0; a < threads; a++)
+    for (long b = 0; b < threads; b++)
+      if (a != b && (size_t)workers[a].first / CACHE_LINE ==
+                        (size_t)workers[b].first / CACHE_LINE) {
+        count++;
+        break;
+      }
+  return count;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "%s: [threads] [iterations] [obj_size] [repetitions]\n", name);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  long threads = 4;
+  if (argc > 1)
+    threads = strtol(argv[1], NULL, 0);
+  if (argc > 2)
+    iterations = strtol(argv[2], NULL, 0);
+  if (argc > 3)
+    obj_size = strtoul(argv[3], NULL, 0);
+  if (argc > 4)
+    repetitions = strtol(argv[4], NULL, 0);
+  if (argc > 5 || threads <= 0 || iterations <= 0 || obj_size == 0 || repetitions <= 0)
+    usage(argv[0]);
+
+  Worker *workers = calloc(threads, sizeof(Worker));
+  pthread_t *ids = calloc(threads, sizeof(pthread_t));
+  for (long t = 0; t < threads; t++) {
+    workers[t].inherited = my_malloc(obj_size);
+    CHECK_NULL(workers[t].inherited);
+  }
+  perf_counters counters;
+  perf_counters_open(&counters);
+  perf_counters_start(&counters);
+  double start = now_s();
+  for (long t = 0; t < threads; t++)
+    if (pthread_create(&ids[t], NULL, run_worker, &workers[t]) != 0) {
+      fprintf(stderr, "pthread_create failed\n");
+      return 1;
+    }
+  for (long t = 0; t < threads; t++)
+    pthread_join(ids[t], NULL);
+  double elapsed = now_s() - start;
+  perf_counters_stop(&counters);
+
+  printf("%f\n", elapsed);
+  printf("threads %ld\n", threads);
+  printf("false_sharing_threads %ld\n", false_sharing_threads(workers, threads));
+  perf_counters_print(&counters);
+  free(workers);
+  free(ids);
+  return 0;
+}
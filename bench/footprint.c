@@ -0,0 +1,195 @@
+#include "../tests/testing.h"
+#include "perf_counters.h"
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Memory footprint benchmark: the randomized workload of
+   internal-tests/fragmentation.c at production scale. It samples the live
+   requested bytes against the memory the process has mapped and resident
+   (from /proc/self/statm, minus what was there before the first my_malloc),
+   and walks the heap with the internal-test helpers to split the overhead
+   into block metadata and free space.
+
+   The first line of output is the time taken, "key value" lines follow. The
+   heap walk is skipped for allocators without the helpers (glibc_shim). */
+
+#define NUM_SAMPLES 200
+
+// Missing from glibc_shim, hence weak
+extern Block *get_start_block(void) __attribute__((weak));
+extern Block *get_next_block(Block *block) __attribute__((weak));
+extern int is_free(Block *block) __attribute__((weak));
+extern size_t block_size(Block *block) __attribute__((weak));
+
+typedef struct {
+  // Process totals, in bytes
+  size_t mapped;
+  size_t resident;
+} footprint;
+
+typedef struct {
+  size_t allocated_bytes;
+  // Free blocks between allocated ones; the free tail of an arena (never
+  // touched, so not resident) is not counted
+  size_t hole_bytes;
+} heap_walk;
+
+static void **ptrs;
+static size_t *sizes;
+static size_t live_bytes = 0;
+
+/* Returns a random number between min and max (inclusive) */
+static int random_in_range(int min, int max) {
+  return min + rand() / (RAND_MAX / (max - min + 1) + 1);
+}
+
+static footprint read_footprint(void) {
+  footprint fp = {0, 0};
+  size_t pages, resident;
+  FILE *statm = fopen("/proc/self/statm", "r");
+  if (statm == NULL)
+    return fp;
+  if (fscanf(statm, "%zu %zu", &pages, &resident) == 2) {
+    fp.mapped = pages * sysconf(_SC_PAGESIZE);
+    fp.resident = resident * sysconf(_SC_PAGESIZE);
+  }
+  fclose(statm);
+  return fp;
+}
+
+static int walk_heap(heap_walk *walk) {
+  memset(walk, 0, sizeof(*walk));
+  if (get_start_block == NULL || get_next_block == NULL || is_free == NULL ||
+      block_size == NULL)
+    return 0;
+  Block *next;
+  for (Block *block = get_start_block(); block; block = next) {
+    size_t size = block_size(block);
+    next = get_next_block(block);
+    // The walk jumps to the next arena after the last block of this one
+    int last = next != (Block *)((char *)block + size);
+    if (!is_free(block))
+      walk->allocated_bytes += size;
+    else if (!last)
+      walk->hole_bytes += size;
+  }
+  return 1;
+}
+
+static long peak_rss_kb(void) {
+  FILE *status = fopen("/proc/self/status", "r");
+  char line[256];
+  long kb = -1;
+  if (status == NULL)
+    return -1;
+  while (kb < 0 && fgets(line, sizeof(line), status))
+    sscanf(line, "VmHWM: %ld kB", &kb);
+  fclose(status);
+  return kb;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "%s: [seed] [repts] [num_ptrs] [max_alloc_size]\n", name);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  unsigned int seed = 2310;
+  // Best-fit free-list scans make the cost superlinear in num_ptrs
+  long repts = 2000000;
+  long num_ptrs = 2000;
+  long max_size = 4096;
+  if (argc > 1)
+    seed = (unsigned int)strtoul(argv[1], NULL, 0);
+  if (argc > 2)
+    repts = strtol(argv[2], NULL, 0);
+  if (argc > 3)
+    num_ptrs = strtol(argv[3], NULL, 0);
+  if (argc > 4)
+    max_size = strtol(argv[4], NULL, 0);
+  if (argc > 5 || repts < NUM_SAMPLES || num_ptrs <= 0 || max_size <= 0 ||
+      max_size > RAND_MAX)
+    usage(argv[0]);
+
+  // The benchmark's own tables are part of the baseline
+  ptrs = calloc(num_ptrs, sizeof(void *));
+  sizes = calloc(num_ptrs, sizeof(size_t));
+  if (ptrs == NULL || sizes == NULL)
+    return 1;
+  memset(ptrs, 0, num_ptrs * sizeof(void *));
+  memset(sizes, 0, num_ptrs * sizeof(size_t));
+  footprint baseline = read_footprint();
+  long baseline_rss_kb = peak_rss_kb();
+  srand(seed);
+
+  size_t peak_live = 0, peak_mapped = 0, peak_resident = 0;
+  double worst_ratio = 0, metadata_sum = 0, fragmentation_sum = 0;
+  double worst_fragmentation = 0;
+  int walks = 0;
+  perf_counters counters;
+  perf_counters_open(&counters);
+  perf_counters_start(&counters);
+  clock_t start_t = clock();
+  for (long i = 0; i < repts; i++) {
+    int idx = random_in_range(0, num_ptrs - 1);
+    if (ptrs[idx] == NULL) {
+      size_t size = (size_t)random_in_range(0, max_size);
+      ptrs[idx] = my_malloc(size);
+      if (ptrs[idx] != NULL) {
+        sizes[idx] = size;
+        live_bytes += size;
+      }
+    } else {
+      my_free(ptrs[idx]);
+      live_bytes -= sizes[idx];
+      ptrs[idx] = NULL;
+    }
+    if (live_bytes > peak_live)
+      peak_live = live_bytes;
+
+    if (i % (repts / NUM_SAMPLES) != 0 || live_bytes == 0)
+      continue;
+    footprint fp = read_footprint();
+    size_t mapped = fp.mapped - baseline.mapped;
+    size_t resident = fp.resident > baseline.resident ? fp.resident - baseline.resident : 0;
+    if (mapped > peak_mapped)
+      peak_mapped = mapped;
+    if (resident > peak_resident)
+      peak_resident = resident;
+    // Ignore the ramp-up, where a few live bytes sit in whole pages
+    if (i >= 4 * num_ptrs && (double)resident / live_bytes > worst_ratio)
+      worst_ratio = (double)resident / live_bytes;
+
+    heap_walk walk;
+    if (walk_heap(&walk)) {
+      // Block headers, footers and padding of the allocated blocks
+      metadata_sum += (double)(walk.allocated_bytes - live_bytes) / live_bytes;
+      // Fraction of the used part of the heap lost to free holes
+      double fragmentation = (double)walk.hole_bytes / (walk.hole_bytes + walk.allocated_bytes);
+      fragmentation_sum += fragmentation;
+      if (fragmentation > worst_fragmentation)
+        worst_fragmentation = fragmentation;
+      walks++;
+    }
+  }
+  clock_t end_t = clock();
+  perf_counters_stop(&counters);
+
+  printf("%f\n", (double)(end_t - start_t) / CLOCKS_PER_SEC);
+  printf("peak_live_bytes %zu\n", peak_live);
+  printf("baseline_rss_kb %ld\n", baseline_rss_kb);
+  printf("peak_rss_kb %ld\n", peak_rss_kb());
+  printf("peak_mapped_kb %zu\n", peak_mapped >> 10);
+  printf("peak_resident_kb %zu\n", peak_resident >> 10);
+  printf("peak_overhead_ratio %.3f\n", peak_live ? (double)peak_resident / peak_live : 0);
+  printf("worst_overhead_ratio %.3f\n", worst_ratio);
+  if (walks) {
+    printf("metadata_overhead %.4f\n", metadata_sum / walks);
+    printf("fragmentation_mean %.4f\n", fragmentation_sum / walks);
+    printf("fragmentation_max %.4f\n", worst_fragmentation);
+  }
+  perf_counters_print(&counters);
+  return 0;
+}
@@ -0,0 +1,124 @@
+#include "../src/mygc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Pause-time benchmark for my_gc: keeps a binary tree of the given depth, then
+   a linked list of list_length nodes linked in random address order, alive
+   and collects each repeatedly with 1, 2, 4, ... max_threads markers. The
+   pause is the wall-clock time of my_gc; with lazy sweeping the sweep column
+   is the work left to my_malloc and is not part of the pause. */
+
+#define NUM_REPS 5
+
+typedef struct TreeNode {
+  struct TreeNode *left;
+  struct TreeNode *right;
+} TreeNode;
+
+static TreeNode *make_tree(int depth) {
+  TreeNode *node = my_malloc(sizeof(TreeNode));
+  if (node == NULL) {
+    fprintf(stderr, "my_malloc returned NULL. Aborting program\n");
+    exit(1);
+  }
+  node->left = depth > 0 ? make_tree(depth - 1) : NULL;
+  node->right = depth > 0 ? make_tree(depth - 1) : NULL;
+  return node;
+}
+
+typedef struct ListNode {
+  struct ListNode *next;
+  size_t value;
+} ListNode;
+
+// Nodes are linked in a random permutation of their allocation order, so
+// that every step of the list is a cache miss for the marker
+static ListNode *make_list(long length) {
+  ListNode **nodes = malloc(length * sizeof(ListNode *));
+  if (nodes == NULL)
+    return NULL;
+  for (long i = 0; i < length; i++) {
+    nodes[i] = my_malloc(sizeof(ListNode));
+    if (nodes[i] == NULL) {
+      fprintf(stderr, "my_malloc returned NULL. Aborting program\n");
+      exit(1);
+    }
+    nodes[i]->value = i;
+  }
+  srand(42);
+  for (long i = length - 1; i > 0; i--) {
+    long j = rand() % (i + 1);
+    ListNode *tmp = nodes[i];
+    nodes[i] = nodes[j];
+    nodes[j] = tmp;
+  }
+  for (long i = 0; i < length; i++)
+    nodes[i]->next = i + 1 < length ? nodes[i + 1] : NULL;
+  ListNode *head = nodes[0];
+  free(nodes);
+  return head;
+}
+
+static double now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "%s: [tree_depth] [max_threads] [list_length]\n", name);
+  exit(1);
+}
+
+static void bench_shape(const char *shape, long max_threads) {
+  GcStats stats;
+  for (long t = 1; t <= max_threads; t <<= 1) {
+    my_gc_set_threads(t);
+    double pause = 0, mark = 0, sweep = 0;
+    for (int i = 0; i < NUM_REPS; i++) {
+      double start = now_ms();
+      my_gc();
+      pause += now_ms() - start;
+      my_gc_finish_sweep();
+      my_gc_get_stats(&stats);
+      mark += stats.mark_ns / 1e6;
+      sweep += stats.sweep_ns / 1e6;
+    }
+    printf("%8s %8d %12.3f %12.3f %12.3f %12.1f %12.1f\n", shape,
+           stats.threads, pause / NUM_REPS, mark / NUM_REPS, sweep / NUM_REPS,
+           stats.live_bytes / (double)(1 << 20),
+           stats.marked_bytes / (double)(1 << 20) / (mark / NUM_REPS / 1e3));
+  }
+}
+
+int main(int argc, char **argv) {
+  set_start_of_stack(__builtin_frame_address(0));
+  long depth = 20;
+  long max_threads = 8;
+  long length = 1 << 20;
+  if (argc > 1)
+    depth = strtol(argv[1], NULL, 0);
+  if (argc > 2)
+    max_threads = strtol(argv[2], NULL, 0);
+  if (argc > 3)
+    length = strtol(argv[3], NULL, 0);
+  if (argc > 4 || depth <= 0 || depth > 26 || max_threads <= 0 || length <= 0)
+    usage(argv[0]);
+
+  // Only the explicit collections below are measured
+  my_gc_set_auto(0);
+  printf("%8s %8s %12s %12s %12s %12s %12s\n", "shape", "threads",
+         "pause (ms)", "mark (ms)", "sweep (ms)", "live (MB)", "mark (MB/s)");
+
+  TreeNode *volatile tree = make_tree(depth);
+  bench_shape("tree", max_threads);
+  tree = NULL;
+
+  ListNode *volatile list = make_list(length);
+  if (list == NULL)
+    return 1;
+  bench_shape("list", max_threads);
+  return tree != NULL || list == NULL;
+}
@@ -0,0 +1,303 @@
+#include "../src/mygc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Collector benchmark suite. Each workload calls my_gc at fixed points
+   (automatic collections are off) and records, per call, the pause, the mark
+   and sweep times and the heap size. Lazy sweeping is finished right after
+   each pause so that its cost is attributed to the collection that found the
+   garbage; it is not part of the pause.
+
+   Workloads:
+     trees   GCBench: a long-lived tree plus short-lived trees of growing depth
+             built top-down and bottom-up
+     lists   long linked lists, one of which is replaced between collections
+     graph   random graph whose live fraction is live_ratio, the rest being
+             rebuilt as garbage between collections
+     arrays  large pointer-free arrays in a ring
+
+   Results are printed as "key value" lines, for bench.py --gc. */
+
+#define MAX_SAMPLES 4096
+
+typedef struct Sample {
+  double pause_ms;
+  double mark_ms;
+  double sweep_ms;
+  size_t marked_bytes;
+  size_t swept_bytes;
+  size_t heap_bytes;
+} Sample;
+
+static Sample samples[MAX_SAMPLES];
+static size_t n_samples = 0;
+
+static double now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void *alloc(size_t size) {
+  void *ptr = my_malloc(size);
+  if (ptr == NULL) {
+    fprintf(stderr, "my_malloc returned NULL. Aborting program\n");
+    exit(1);
+  }
+  memset(ptr, 0, size);
+  return ptr;
+}
+
+// Overwrites dead stack slots, so that a stale pointer left by the workload
+// does not retain a whole garbage graph or list (builders are not inlined for
+// the same reason)
+__attribute__((noinline)) static void clear_stack(void) {
+  volatile char junk[16384];
+  for (size_t i = 0; i < sizeof(junk); i++)
+    junk[i] = 0;
+}
+
+__attribute__((noinline)) static void collect(void) {
+  GcStats stats;
+  double start = now_ms();
+  my_gc();
+  double pause = now_ms() - start;
+  my_gc_finish_sweep();
+  my_gc_get_stats(&stats);
+  if (n_samples == MAX_SAMPLES)
+    return;
+  samples[n_samples++] = (Sample){
+      .pause_ms = pause,
+      .mark_ms = stats.mark_ns / 1e6,
+      .sweep_ms = stats.sweep_ns / 1e6,
+      .marked_bytes = stats.marked_bytes,
+      .swept_bytes = stats.live_bytes + stats.freed_bytes,
+      .heap_bytes = stats.heap_bytes,
+  };
+}
+
+// Collects and records one sample. collect() runs in the frame just scrubbed
+// by clear_stack(), its uninitialised locals cannot hold workload pointers.
+static void gc_point(void) {
+  clear_stack();
+  collect();
+}
+
+// ================================== Trees ===================================
+
+typedef struct TreeNode {
+  struct TreeNode *left;
+  struct TreeNode *right;
+} TreeNode;
+
+static TreeNode *tree_bottom_up(int depth) {
+  TreeNode *node = alloc(sizeof(TreeNode));
+  if (depth > 0) {
+    node->left = tree_bottom_up(depth - 1);
+    node->right = tree_bottom_up(depth - 1);
+  }
+  return node;
+}
+
+static void tree_top_down(TreeNode *node, int depth) {
+  if (depth > 0) {
+    node->left = alloc(sizeof(TreeNode));
+    node->right = alloc(sizeof(TreeNode));
+    tree_top_down(node->left, depth - 1);
+    tree_top_down(node->right, depth - 1);
+  }
+}
+
+static void run_trees(int scale) {
+  int long_lived_depth = 12 + scale;
+  int max_depth = 12 + scale;
+  TreeNode *volatile long_lived = tree_bottom_up(long_lived_depth);
+  double *volatile array = my_malloc_atomic(500000 * sizeof(double));
+  for (int i = 0; i < 500000; i++)
+    array[i] = 1.0 / (i + 1);
+
+  for (int depth = 4; depth <= max_depth; depth += 2) {
+    long iterations = 2l << (max_depth - depth + 2);
+    for (long i = 0; i < iterations; i++) {
+      TreeNode *tmp = alloc(sizeof(TreeNode));
+      tree_top_down(tmp, depth);
+    }
+    gc_point();
+    for (long i = 0; i < iterations; i++)
+      tree_bottom_up(depth);
+    gc_point();
+  }
+  if (long_lived == NULL || array[1000] != 1.0 / 1001)
+    exit(1);
+}
+
+// ================================== Lists ===================================
+
+#define NUM_LISTS 8
+#define LIST_ROUNDS 32
+
+typedef struct ListNode {
+  struct ListNode *next;
+  size_t value;
+} ListNode;
+
+__attribute__((noinline)) static ListNode *make_list(long length) {
+  ListNode *head = NULL;
+  for (long i = 0; i < length; i++) {
+    ListNode *node = alloc(sizeof(ListNode));
+    node->next = head;
+    node->value = i;
+    head = node;
+  }
+  return head;
+}
+
+static void run_lists(int scale) {
+  long length = 1l << (12 + scale);
+  ListNode **lists = alloc(NUM_LISTS * sizeof(ListNode *));
+  for (int i = 0; i < NUM_LISTS; i++)
+    lists[i] = make_list(length);
+  for (int round = 0; round < LIST_ROUNDS; round++) {
+    lists[round % NUM_LISTS] = make_list(length);
+    gc_point();
+  }
+}
+
+// ================================== Graph ===================================
+
+#define GRAPH_DEGREE 4
+#define GRAPH_ROUNDS 16
+
+typedef struct GraphNode {
+  struct GraphNode *edges[GRAPH_DEGREE];
+  size_t id;
+} GraphNode;
+
+__attribute__((noinline)) static GraphNode **make_graph(long n_nodes) {
+  GraphNode **nodes = alloc(n_nodes * sizeof(GraphNode *));
+  for (long i = 0; i < n_nodes; i++) {
+    nodes[i] = alloc(sizeof(GraphNode));
+    nodes[i]->id = i;
+  }
+  for (long i = 0; i < n_nodes; i++)
+    for (int e = 0; e < GRAPH_DEGREE; e++)
+      nodes[i]->edges[e] = nodes[rand() % n_nodes];
+  return nodes;
+}
+
+/* The live part stays reachable from `live` for the whole run. The garbage
+   part is a separate graph of the same shape, rebuilt before every collection,
+   so each collection finds (1 - live_ratio) of the heap dead. */
+static void run_graph(int scale, double live_ratio) {
+  long n_nodes = 1l << (14 + scale);
+  long n_live = (long)(n_nodes * live_ratio);
+  long n_dead = n_nodes - n_live;
+  srand(42);
+  GraphNode **live = n_live ? make_graph(n_live) : NULL;
+  for (int round = 0; round < GRAPH_ROUNDS; round++) {
+    if (n_dead)
+      make_graph(n_dead);
+    // Rewire part of the live graph, as a mutator would
+    for (long i = 0; i < n_live / 16; i++)
+      live[rand() % n_live]->edges[rand() % GRAPH_DEGREE] = live[rand() % n_live];
+    gc_point();
+  }
+}
+
+// ================================== Arrays ==================================
+
+#define ARRAY_RING 16
+#define ARRAY_ROUNDS 256
+
+static void run_arrays(int scale) {
+  size_t size = (size_t)1 << (16 + scale);
+  void **ring = alloc(ARRAY_RING * sizeof(void *));
+  for (int round = 0; round < ARRAY_ROUNDS; round++) {
+    char *array = my_malloc_atomic(size);
+    if (array == NULL) {
+      fprintf(stderr, "my_malloc_atomic returned NULL. Aborting program\n");
+      exit(1);
+    }
+    memset(array, round, size);
+    ring[round % ARRAY_RING] = array;
+    if (round % 8 == 7)
+      gc_point();
+  }
+}
+
+// ================================== Report ==================================
+
+static int cmp_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return x < y ? -1 : x > y;
+}
+
+static double percentile(const double *sorted, size_t n, double p) {
+  size_t i = (size_t)(p * (n - 1) + 0.5);
+  return sorted[i < n ? i : n - 1];
+}
+
+static void report(const char *workload, double total_ms) {
+  static double pauses[MAX_SAMPLES];
+  double mark_ms = 0, sweep_ms = 0;
+  double marked = 0, swept = 0;
+  for (size_t i = 0; i < n_samples; i++) {
+    pauses[i] = samples[i].pause_ms;
+    mark_ms += samples[i].mark_ms;
+    sweep_ms += samples[i].sweep_ms;
+    marked += samples[i].marked_bytes;
+    swept += samples[i].swept_bytes;
+  }
+  qsort(pauses, n_samples, sizeof(double), cmp_double);
+
+  double mb = 1 << 20;
+  size_t first_heap = samples[0].heap_bytes;
+  size_t last_heap = samples[n_samples - 1].heap_bytes;
+  printf("workload %s\n", workload);
+  printf("total_s %.6f\n", total_ms / 1e3);
+  printf("collections %zu\n", n_samples);
+  printf("pause_min_ms %.3f\n", pauses[0]);
+  printf("pause_p50_ms %.3f\n", percentile(pauses, n_samples, 0.50));
+  printf("pause_p90_ms %.3f\n", percentile(pauses, n_samples, 0.90));
+  printf("pause_p99_ms %.3f\n", percentile(pauses, n_samples, 0.99));
+  printf("pause_max_ms %.3f\n", pauses[n_samples - 1]);
+  printf("mark_mb_per_s %.1f\n", mark_ms > 0 ? marked / mb / (mark_ms / 1e3) : 0);
+  printf("sweep_mb_per_s %.1f\n", sweep_ms > 0 ? swept / mb / (sweep_ms / 1e3) : 0);
+  printf("live_mb %.1f\n", samples[n_samples - 1].marked_bytes / mb);
+  printf("heap_mb %.1f\n", last_heap / mb);
+  printf("heap_growth_kb_per_gc %.1f\n",
+         n_samples > 1 ? ((double)last_heap - first_heap) / 1024 / (n_samples - 1) : 0);
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "%s: <trees|lists|graph|arrays> [scale] [live_ratio]\n", name);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  set_start_of_stack(__builtin_frame_address(0));
+  if (argc < 2 || argc > 4)
+    usage(argv[0]);
+  const char *workload = argv[1];
+  int scale = argc > 2 ? atoi(argv[2]) : 4;
+  double live_ratio = argc > 3 ? atof(argv[3]) : 0.5;
+  if (scale < 0 || scale > 8 || live_ratio < 0 || live_ratio > 1)
+    usage(argv[0]);
+
+  my_gc_set_auto(0);
+  double start = now_ms();
+  if (strcmp(workload, "trees") == 0)
+    run_trees(scale);
+  else if (strcmp(workload, "lists") == 0)
+    run_lists(scale);
+  else if (strcmp(workload, "graph") == 0)
+    run_graph(scale, live_ratio);
+  else if (strcmp(workload, "arrays") == 0)
+    run_arrays(scale);
+  else
+    usage(argv[0]);
+  report(workload, now_ms() - start);
+  return 0;
+}
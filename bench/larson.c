@@ -0,0 +1,143 @@
+#include "../tests/testing.h"
+#include "perf_counters.h"
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+/* Port of the Larson & Krishnan server benchmark. Every thread owns a table of
+   blocks and, for a number of rounds, frees a random one and replaces it with
+   a block of random size. Then it exits and hands its table over to a new
+   thread, which goes on freeing blocks allocated by its predecessor, as a
+   server does with connections handed from thread to thread. The initial
+   tables are filled by the main thread, so the first frees are cross-thread
+   too.
+
+   Build the allocator with THREADSAFE=1. The first line of output is the wall
+   time, "key value" lines follow. */
+
+typedef struct {
+  void **blocks;
+  unsigned int seed;
+  long generation;
+  long ops;
+} Chain;
+
+static long num_chunks = 1000;
+static long rounds = 10000;
+static long generations = 10;
+static size_t min_size = 16;
+static size_t max_size = 128;
+// Chains whose last generation has finished
+static long done = 0;
+static pthread_mutex_t done_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+
+static double now_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *alloc(size_t size) {
+  char *ptr = my_malloc(size);
+  CHECK_NULL(ptr);
+  // Touch the block, as a server filling a buffer would
+  ptr[0] = ptr[size - 1] = 1;
+  return ptr;
+}
+
+static void *run_generation(void *arg);
+
+static size_t random_size(unsigned int *seed) {
+  return min_size + rand_r(seed) % (max_size - min_size + 1);
+}
+
+static void start_generation(Chain *chain) {
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, run_generation, chain) != 0) {
+    fprintf(stderr, "pthread_create failed\n");
+    exit(1);
+  }
+  pthread_detach(thread);
+}
+
+static void *run_generation(void *arg) {
+  Chain *chain = arg;
+  for (long i = 0; i < rounds; i++) {
+    long idx = rand_r(&chain->seed) % num_chunks;
+    my_free(chain->blocks[idx]);
+    chain->blocks[idx] = alloc(random_size(&chain->seed));
+  }
+  // One my_free and one my_malloc per round
+  chain->ops += 2 * rounds;
+  // Hand the table over to a fresh thread
+  if (++chain->generation < generations) {
+    start_generation(chain);
+    return NULL;
+  }
+  pthread_mutex_lock(&done_lock);
+  done++;
+  pthread_cond_signal(&done_cond);
+  pthread_mutex_unlock(&done_lock);
+  return NULL;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "%s: [threads] [generations] [rounds] [chunks] [min_size] [max_size]\n", name);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  long threads = 4;
+  if (argc > 1)
+    threads = strtol(argv[1], NULL, 0);
+  if (argc > 2)
+    generations = strtol(argv[2], NULL, 0);
+  if (argc > 3)
+    rounds = strtol(argv[3], NULL, 0);
+  if (argc > 4)
+    num_chunks = strtol(argv[4], NULL, 0);
+  if (argc > 5)
+    min_size = strtoul(argv[5], NULL, 0);
+  if (argc > 6)
+    max_size = strtoul(argv[6], NULL, 0);
+  if (argc > 7 || threads <= 0 || generations <= 0 || rounds <= 0 ||
+      num_chunks <= 0 || min_size == 0 || max_size < min_size)
+    usage(argv[0]);
+
+  Chain *chains = calloc(threads, sizeof(Chain));
+  for (long t = 0; t < threads; t++) {
+    chains[t].blocks = calloc(num_chunks, sizeof(void *));
+    chains[t].seed = 2310 + t;
+    for (long i = 0; i < num_chunks; i++)
+      chains[t].blocks[i] = alloc(random_size(&chains[t].seed));
+  }
+
+  perf_counters counters;
+  perf_counters_open(&counters);
+  perf_counters_start(&counters);
+  double start = now_s();
+  for (long t = 0; t < threads; t++)
+    start_generation(&chains[t]);
+  pthread_mutex_lock(&done_lock);
+  while (done < threads)
+    pthread_cond_wait(&done_cond, &done_lock);
+  pthread_mutex_unlock(&done_lock);
+  double elapsed = now_s() - start;
+  perf_counters_stop(&counters);
+  long ops = 0;
+  for (long t = 0; t < threads; t++)
+    ops += chains[t].ops;
+
+  printf("%f\n", elapsed);
+  printf("threads %ld\n", threads);
+  printf("ops_per_s %.0f\n", ops / elapsed);
+  perf_counters_print(&counters);
+  for (long t = 0; t < threads; t++) {
+    for (long i = 0; i < num_chunks; i++)
+      my_free(chains[t].blocks[i]);
+    free(chains[t].blocks);
+  }
+  free(chains);
+  return 0;
+}
@@ -0,0 +1,123 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Hardware performance counters around the measured region of a benchmark,
+   enabled by setting $BENCH_PERF (bench.py --perf). Counters count user space
+   only, in the calling thread and the threads it creates after
+   perf_counters_start. Counters the kernel or the CPU refuses (no PMU in a VM,
+   perf_event_paranoid, seccomp) are left out; if none can be opened nothing is
+   printed. On other systems every call is a no-op.
+
+   perf_counters_print adds one "key value" line per counter, scaled by the
+   time the counter was actually scheduled when they were multiplexed. */
+
+#define PERF_NUM_COUNTERS 6
+
+typedef struct {
+  int fds[PERF_NUM_COUNTERS];
+  uint64_t values[PERF_NUM_COUNTERS];
+} perf_counters;
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const struct {
+  const char *name;
+  uint32_t type;
+  uint64_t config;
+} perf_events[PERF_NUM_COUNTERS] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"l1d_misses", PERF_TYPE_HW_CACHE,
+     PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {"llc_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {"dtlb_misses", PERF_TYPE_HW_CACHE,
+     PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+static inline void perf_counters_open(perf_counters *pc) {
+  memset(pc->values, 0, sizeof(pc->values));
+  for (int i = 0; i < PERF_NUM_COUNTERS; i++)
+    pc->fds[i] = -1;
+  if (getenv("BENCH_PERF") == NULL)
+    return;
+  for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = perf_events[i].type;
+    attr.config = perf_events[i].config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // Separate events rather than a group: one unsupported event would make
+    // the whole group fail to open
+    pc->fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+}
+
+static inline void perf_counters_start(perf_counters *pc) {
+  for (int i = 0; i < PERF_NUM_COUNTERS; i++)
+    if (pc->fds[i] >= 0) {
+      ioctl(pc->fds[i], PERF_EVENT_IOC_RESET, 0);
+      ioctl(pc->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+static inline void perf_counters_stop(perf_counters *pc) {
+  for (int i = 0; i < PERF_NUM_COUNTERS; i++)
+    if (pc->fds[i] >= 0)
+      ioctl(pc->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+  for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+    // value, time enabled, time running
+    uint64_t data[3];
+    if (pc->fds[i] < 0)
+      continue;
+    if (read(pc->fds[i], data, sizeof(data)) != sizeof(data) || data[2] == 0) {
+      close(pc->fds[i]);
+      pc->fds[i] = -1;
+      continue;
+    }
+    pc->values[i] = data[2] < data[1] ? (uint64_t)((double)data[0] * data[1] / data[2]) : data[0];
+  }
+}
+
+static inline void perf_counters_print(perf_counters *pc) {
+  for (int i = 0; i < PERF_NUM_COUNTERS; i++)
+    if (pc->fds[i] >= 0)
+      printf("%s %llu\n", perf_events[i].name, (unsigned long long)pc->values[i]);
+  if (pc->fds[0] >= 0 && pc->fds[1] >= 0 && pc->values[0] > 0)
+    printf("ipc %.3f\n", (double)pc->values[1] / pc->values[0]);
+  for (int i = 0; i < PERF_NUM_COUNTERS; i++)
+    if (pc->fds[i] >= 0) {
+      close(pc->fds[i]);
+      pc->fds[i] = -1;
+    }
+}
+
+#else
+
+static inline void perf_counters_open(perf_counters *pc) {
+  for (int i = 0; i < PERF_NUM_COUNTERS; i++)
+    pc->fds[i] = -1;
+}
+static inline void perf_counters_start(perf_counters *pc) { (void)pc; }
+static inline void perf_counters_stop(perf_counters *pc) { (void)pc; }
+static inline void perf_counters_print(perf_counters *pc) { (void)pc; }
+
+#endif
+
+#endif
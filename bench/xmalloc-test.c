@@ -0,0 +1,149 @@
+#include "../tests/testing.h"
+#include "perf_counters.h"
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+/* Port of xmalloc-test (Lever & Boreham). Producer threads allocate blocks of
+   random size in batches and pass the batches through a bounded queue to
+   consumer threads, which free them: every block is freed by a different
+   thread than the one that allocated it.
+
+   Build the allocator with THREADSAFE=1. The first line of output is the wall
+   time, "key value" lines follow. */
+
+#define BATCH_SIZE 64
+#define QUEUE_CAPACITY 64
+
+typedef struct {
+  void *blocks[BATCH_SIZE];
+} Batch;
+
+static struct {
+  Batch *batches[QUEUE_CAPACITY];
+  size_t head;
+  size_t count;
+  // Producers still running
+  long producers;
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+} queue = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .not_empty = PTHREAD_COND_INITIALIZER,
+    .not_full = PTHREAD_COND_INITIALIZER,
+};
+
+static long batches_per_producer = 20000;
+static size_t max_size = 120;
+
+static double now_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void push(Batch *batch) {
+  pthread_mutex_lock(&queue.lock);
+  while (queue.count == QUEUE_CAPACITY)
+    pthread_cond_wait(&queue.not_full, &queue.lock);
+  queue.batches[(queue.head + queue.count++) % QUEUE_CAPACITY] = batch;
+  pthread_cond_signal(&queue.not_empty);
+  pthread_mutex_unlock(&queue.lock);
+}
+
+// Returns NULL once the queue is empty and every producer is done
+static Batch *pop(void) {
+  pthread_mutex_lock(&queue.lock);
+  while (queue.count == 0 && queue.producers > 0)
+    pthread_cond_wait(&queue.not_empty, &queue.lock);
+  Batch *batch = NULL;
+  if (queue.count > 0) {
+    batch = queue.batches[queue.head];
+    queue.head = (queue.head + 1) % QUEUE_CAPACITY;
+    queue.count--;
+    pthread_cond_signal(&queue.not_full);
+  }
+  pthread_mutex_unlock(&queue.lock);
+  return batch;
+}
+
+static void *produce(void *arg) {
+  unsigned int seed = (unsigned int)(size_t)arg;
+  for (long i = 0; i < batches_per_producer; i++) {
+    Batch *batch = my_malloc(sizeof(Batch));
+    CHECK_NULL(batch);
+    for (int j = 0; j < BATCH_SIZE; j++) {
+      size_t size = 8 + rand_r(&seed) % (max_size - 7);
+      batch->blocks[j] = my_malloc(size);
+      CHECK_NULL(batch->blocks[j]);
+      memset(batch->blocks[j], j, size);
+    }
+    push(batch);
+  }
+  pthread_mutex_lock(&queue.lock);
+  if (--queue.producers == 0)
+    pthread_cond_broadcast(&queue.not_empty);
+  pthread_mutex_unlock(&queue.lock);
+  return NULL;
+}
+
+static void *consume(void *arg) {
+  Batch *batch;
+  (void)arg;
+  while ((batch = pop()) != NULL) {
+    for (int j = 0; j < BATCH_SIZE; j++)
+      my_free(batch->blocks[j]);
+    my_free(batch);
+  }
+  return NULL;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "%s: [producers] [consumers] [batches_per_producer] [max_size]\n", name);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  long producers = 2, consumers = 2;
+  if (argc > 1)
+    producers = strtol(argv[1], NULL, 0);
+  if (argc > 2)
+    consumers = strtol(argv[2], NULL, 0);
+  if (argc > 3)
+    batches_per_producer = strtol(argv[3], NULL, 0);
+  if (argc > 4)
+    max_size = strtoul(argv[4], NULL, 0);
+  if (argc > 5 || producers <= 0 || consumers <= 0 ||
+      batches_per_producer <= 0 || max_size < 8)
+    usage(argv[0]);
+
+  pthread_t *threads = calloc(producers + consumers, sizeof(pthread_t));
+  queue.producers = producers;
+  perf_counters counters;
+  perf_counters_open(&counters);
+  perf_counters_start(&counters);
+  double start = now_s();
+  for (long t = 0; t < producers + consumers; t++) {
+    int err = t < producers
+                  ? pthread_create(&threads[t], NULL, produce, (void *)(size_t)(2310 + t))
+                  : pthread_create(&threads[t], NULL, consume, NULL);
+    if (err != 0) {
+      fprintf(stderr, "pthread_create failed\n");
+      return 1;
+    }
+  }
+  for (long t = 0; t < producers + consumers; t++)
+    pthread_join(threads[t], NULL);
+  double elapsed = now_s() - start;
+  perf_counters_stop(&counters);
+
+  // One my_malloc and one my_free per block and per batch
+  double ops = 2.0 * producers * batches_per_producer * (BATCH_SIZE + 1);
+  printf("%f\n", elapsed);
+  printf("threads %ld\n", producers + consumers);
+  printf("ops_per_s %.0f\n", ops / elapsed);
+  perf_counters_print(&counters);
+  free(threads);
+  return 0;
+}
@@ -1,14 +1,32 @@
 #include "src/mygc.h"
+#include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 
 /** This is a template file for you to use for testing your garbage collector
- *  implementation. 
+ *  implementation.
  *  It is up to you to determine how to effectively test your GC code.
- * 
+ *
  *  If you are not planning on implementing the garbage collector you may ignore
  *  this file.
  */
 
+#define LIST_LENGTH 1000
+#define TABLE_LENGTH 100
+
+typedef struct Node {
+  struct Node *next;
+  size_t value;
+} Node;
+
+static void **registered_table;
+static void **unregistered_table;
+
+// Keep locals on the real stack under ASan so the collector can see them.
+const char *__asan_default_options(void) {
+  return "detect_stack_use_after_return=0";
+}
+
 // Version of your malloc that clears the block returned by malloc. To make sure when testing
 // that there aren't random values in the blocks which just so happen to be pointers to other blocks.
 void *my_calloc_gc(size_t size) {
@@ -17,15 +35,176 @@ void *my_calloc_gc(size_t size) {
   return p;
 }
 
+__attribute__((noinline)) Node *make_list(size_t length) {
+  Node *head = NULL;
+  for (size_t i = 0; i < length; i++) {
+    Node *node = my_calloc_gc(sizeof(Node));
+    node->next = head;
+    node->value = i;
+    head = node;
+  }
+  return head;
+}
+
+// Overwrite dead stack slots left behind by earlier calls
+__attribute__((noinline)) void **make_table(void *(*alloc)(size_t)) {
+  void **table = alloc(TABLE_LENGTH * sizeof(void *));
+  for (size_t i = 0; i < TABLE_LENGTH; i++)
+    table[i] = my_calloc_gc(sizeof(Node));
+  return table;
+}
+
+// Allocates `bytes` of short-lived garbage
+__attribute__((noinline)) void churn(size_t bytes) {
+  for (size_t i = 0; i < bytes / 64; i++)
+    my_calloc_gc(64);
+}
+
+__attribute__((noinline)) void clear_stack(void) {
+  volatile char junk[16384];
+  // Volatile stores: a memset of a dead array would be optimized away
+  for (size_t i = 0; i < sizeof(junk); i++)
+    junk[i] = 0;
+}
+
+// Independent blocks: a stale word on the stack can only retain one of them
+__attribute__((noinline)) void drop_blocks(size_t count) {
+  for (size_t i = 0; i < count; i++)
+    my_calloc_gc(sizeof(Node));
+}
+
 int main(void) {
   set_start_of_stack(__builtin_frame_address(0));
-  // Replace below with your own GC tests
+  // Small mark stacks, so that wide heap objects overflow them
+  setenv("MYGC_MARK_STACK_LIMIT", "256", 1);
+  my_gc_set_lazy_sweep(1);
+  my_gc_set_auto(0);
+  GcStats stats;
+
+  // Reachable list survives, including through an interior pointer
+  Node *volatile head = make_list(LIST_LENGTH);
+  char *volatile inner = (char *)my_calloc_gc(256) + 100;
+  clear_stack();
+  my_gc();
+  size_t expected = LIST_LENGTH;
+  for (Node *node = head; node; node = node->next) {
+    assert(!is_free(ptr_to_block(node)));
+    assert(node->value == --expected);
+  }
+  assert(expected == 0);
+  assert(!is_free(ptr_to_block(inner - 100)));
+
+  // Unreachable blocks are reclaimed, lazily by the next my_malloc
+  drop_blocks(LIST_LENGTH);
+  clear_stack();
+  my_gc();
+  my_gc_get_stats(&stats);
+  assert(stats.unswept_arenas == 1 && stats.freed_blocks == 0);
+  my_calloc_gc(sizeof(Node));
+  my_gc_get_stats(&stats);
+  assert(stats.unswept_arenas == 0);
+  assert(stats.freed_blocks >= LIST_LENGTH - 10);
+
+  // Blocks only referenced from the heap live until the table forgets them,
+  // even when there are too many of them for the mark stack
+  void **volatile table = my_calloc_gc(LIST_LENGTH * sizeof(void *));
+  for (size_t i = 0; i < LIST_LENGTH; i++) {
+    Node *node = my_calloc_gc(sizeof(Node));
+    node->next = my_calloc_gc(sizeof(Node));
+    table[i] = node;
+  }
+  clear_stack();
+  my_gc();
+  my_gc_get_stats(&stats);
+  assert(stats.rescans > 0);
+  for (size_t i = 0; i < LIST_LENGTH; i++) {
+    assert(!is_free(ptr_to_block(table[i])));
+    assert(!is_free(ptr_to_block(((Node *)table[i])->next)));
+  }
+  memset(table, 0, LIST_LENGTH * sizeof(void *));
+  clear_stack();
+  my_gc();
+  my_gc_finish_sweep();
+  my_gc_get_stats(&stats);
+  assert(stats.freed_blocks >= 2 * LIST_LENGTH - 10);
+  assert(!is_free(ptr_to_block(head)));
+  assert(!is_free(ptr_to_block(inner - 100)));
 
-  char *a = my_calloc_gc(8);
-  char *b = my_calloc_gc(16);
-  b = NULL;
+  // Atomic blocks are kept but not scanned
+  void **volatile atomic = make_table(my_malloc_atomic);
+  clear_stack();
+  my_gc();
+  my_gc_finish_sweep();
+  my_gc_get_stats(&stats);
+  assert(!is_free(ptr_to_block(atomic)));
+  assert(stats.freed_blocks >= TABLE_LENGTH - 10);
 
+  // Registered roots are scanned, the rest of the data segment no longer is
+  my_gc_add_root(&registered_table, sizeof(registered_table));
+  registered_table = make_table(my_calloc_gc);
+  unregistered_table = make_table(my_calloc_gc);
+  clear_stack();
   my_gc();
+  my_gc_finish_sweep();
+  my_gc_get_stats(&stats);
+  for (size_t i = 0; i < TABLE_LENGTH; i++)
+    assert(!is_free(ptr_to_block(registered_table[i])));
+  assert(stats.freed_blocks >= TABLE_LENGTH - 10);
+  my_gc_remove_root(&registered_table);
+
+  // Automatic collections keep a churning program inside its first arena
+  my_gc_get_stats(&stats);
+  size_t collections = stats.collections;
+  my_gc_set_trigger(1.0, 1 << 20);
+  my_gc_set_auto(1);
+  churn(4 * kMemorySize);
+  my_gc_set_auto(0);
+  my_gc_get_stats(&stats);
+  assert(stats.collections > collections);
+  assert(stats.arenas == 1);
+
+  // Generational mode: a young block only referenced from an old one through
+  // the write barrier survives a minor collection and gets promoted
+  my_gc_set_generational(1, 1 << 20);
+  Node *volatile old = my_calloc_gc(sizeof(Node));
+  clear_stack();
+  my_gc_minor();
+  assert(IS_OLD(ptr_to_block(old)));
+  MY_GC_WRITE(&old->next, (Node *)my_calloc_gc(sizeof(Node)));
+  old->next->value = 42;
+  drop_blocks(TABLE_LENGTH);
+  clear_stack();
+  my_gc_minor();
+  my_gc_get_stats(&stats);
+  assert(IS_OLD(ptr_to_block(old->next)) && old->next->value == 42);
+  assert(stats.promoted_bytes < 4 * TABLE_LENGTH * sizeof(Node));
 
-  // At this point the block "b" should have been freed as garbage as no pointers exist to it anymore
+  // Short-lived garbage dies in the nursery without growing the heap
+  size_t arenas = stats.arenas;
+  churn(16 << 20);
+  my_gc_get_stats(&stats);
+  assert(stats.minor_collections >= 16);
+  assert(stats.arenas == arenas);
+  assert(old->next->value == 42);
+
+  // A nursery more than half full of live blocks retires into the old heap
+  // on a full collection: it was swept then, lazy sweeping must skip it
+  clear_stack();
+  my_gc();
+  my_gc_finish_sweep();
+  size_t young = (6 << 20) / 10 / block_size(ptr_to_block(old));
+  Node **volatile live = my_calloc_gc(young * sizeof(Node *));
+  for (size_t i = 0; i < young; i++) {
+    live[i] = my_calloc_gc(sizeof(Node));
+    live[i]->value = i;
+  }
+  clear_stack();
+  my_gc();
+  my_gc_finish_sweep();
+  my_gc_get_stats(&stats);
+  assert(stats.freed_blocks < young / 2);
+  for (size_t i = 0; i < young; i++)
+    assert(IS_OLD(ptr_to_block(live[i])) && live[i]->value == i);
+  my_gc_set_generational(0, 0);
+  return 0;
 }
@@ -0,0 +1,33 @@
+#include "mymalloc.h"
+#include <stdlib.h>
+
+/* Baseline for benchmarks (MALLOC=glibc_shim): my_malloc / my_free forwarded
+   to the C library allocator. Only the allocation API is provided, the
+   internal-test helpers depend on a block layout glibc does not expose. */
+
+void *my_malloc(size_t size) {
+  if (size == 0)
+    return NULL;
+  return malloc(size);
+}
+
+void my_free(void *ptr) {
+  free(ptr);
+}
+
+void my_free_sized(void *ptr, size_t size) {
+  (void)size;
+  free(ptr);
+}
+
+void *my_aligned_alloc(size_t alignment, size_t size) {
+  void *ptr;
+  // As my_aligned_alloc in mymalloc.c, rather than posix_memalign's EINVAL
+  if (alignment & (alignment - 1))
+    return NULL;
+  if (size == 0 || alignment < sizeof(void *))
+    return my_malloc(size);
+  if (posix_memalign(&ptr, alignment, size) != 0)
+    return NULL;
+  return ptr;
+}
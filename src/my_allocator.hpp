@@ -0,0 +1,165 @@
+#ifndef MY_ALLOCATOR_HPP
+#define MY_ALLOCATOR_HPP
+
+#include "mymalloc.h"
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+
+/* C++ adaptors over my_malloc / my_free: my_allocator<T> for the standard
+   containers (std::vector<int, my_allocator<int>>) and my_memory_resource for
+   the std::pmr ones (std::pmr::vector<int> v(my_heap_resource())). Types and
+   requests aligned beyond a word go through my_aligned_alloc. Allocation
+   failure throws std::bad_alloc.
+
+   The adaptors bound to one Heap (my_heap_allocator<T>,
+   my_heap_memory_resource) or Region (my_region_resource) need
+   MALLOC=mymalloc. */
+
+namespace my_malloc_detail {
+
+inline void *allocate(std::size_t bytes, std::size_t alignment) {
+  // my_malloc returns NULL for 0 bytes, the C++ interfaces need a pointer
+  if (bytes == 0)
+    bytes = 1;
+  void *ptr = alignment > sizeof(std::size_t) ? my_aligned_alloc(alignment, bytes)
+                                              : my_malloc(bytes);
+  if (ptr == nullptr)
+    throw std::bad_alloc();
+  return ptr;
+}
+
+inline void *allocate(Heap *heap, std::size_t bytes, std::size_t alignment) {
+  void *ptr = my_heap_aligned_alloc(heap, alignment, bytes == 0 ? 1 : bytes);
+  if (ptr == nullptr)
+    throw std::bad_alloc();
+  return ptr;
+}
+
+} // namespace my_malloc_detail
+
+template <class T> struct my_allocator {
+  using value_type = T;
+
+  my_allocator() noexcept = default;
+  template <class U> my_allocator(const my_allocator<U> &) noexcept {}
+
+  T *allocate(std::size_t n) {
+    if (n > static_cast<std::size_t>(-1) / sizeof(T))
+      throw std::bad_array_new_length();
+    return static_cast<T *>(my_malloc_detail::allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T *ptr, std::size_t n) noexcept { my_free_sized(ptr, n * sizeof(T)); }
+};
+
+// There is one heap, so any two allocators can free each other's memory
+template <class T, class U>
+bool operator==(const my_allocator<T> &, const my_allocator<U> &) noexcept {
+  return true;
+}
+
+template <class T, class U>
+bool operator!=(const my_allocator<T> &, const my_allocator<U> &) noexcept {
+  return false;
+}
+
+class my_memory_resource : public std::pmr::memory_resource {
+protected:
+  void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+    return my_malloc_detail::allocate(bytes, alignment);
+  }
+
+  void do_deallocate(void *ptr, std::size_t bytes, std::size_t) override {
+    my_free_sized(ptr, bytes);
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+    return dynamic_cast<const my_memory_resource *>(&other) != nullptr;
+  }
+};
+
+// The resource over the my_malloc heap
+inline my_memory_resource *my_heap_resource() {
+  static my_memory_resource resource;
+  return &resource;
+}
+
+// Allocates from one heap; allocators over the same heap compare equal
+template <class T> struct my_heap_allocator {
+  using value_type = T;
+
+  explicit my_heap_allocator(Heap *heap) noexcept : heap(heap) {}
+  template <class U> my_heap_allocator(const my_heap_allocator<U> &other) noexcept : heap(other.heap) {}
+
+  T *allocate(std::size_t n) {
+    if (n > static_cast<std::size_t>(-1) / sizeof(T))
+      throw std::bad_array_new_length();
+    return static_cast<T *>(my_malloc_detail::allocate(heap, n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T *ptr, std::size_t) noexcept { my_heap_free(heap, ptr); }
+
+  Heap *heap;
+};
+
+template <class T, class U>
+bool operator==(const my_heap_allocator<T> &a, const my_heap_allocator<U> &b) noexcept {
+  return a.heap == b.heap;
+}
+
+template <class T, class U>
+bool operator!=(const my_heap_allocator<T> &a, const my_heap_allocator<U> &b) noexcept {
+  return a.heap != b.heap;
+}
+
+// The resource over one heap, which must outlive it
+class my_heap_memory_resource : public std::pmr::memory_resource {
+public:
+  explicit my_heap_memory_resource(Heap *heap) noexcept : heap_(heap) {}
+  Heap *heap() const noexcept { return heap_; }
+
+protected:
+  void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+    return my_malloc_detail::allocate(heap_, bytes, alignment);
+  }
+
+  void do_deallocate(void *ptr, std::size_t, std::size_t) override { my_heap_free(heap_, ptr); }
+
+  bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+    auto *resource = dynamic_cast<const my_heap_memory_resource *>(&other);
+    return resource != nullptr && resource->heap_ == heap_;
+  }
+
+private:
+  Heap *heap_;
+};
+
+/* The resource over a region, like std::pmr::monotonic_buffer_resource:
+   deallocate does nothing, the memory comes back with my_region_reset or
+   my_region_destroy. */
+class my_region_resource : public std::pmr::memory_resource {
+public:
+  explicit my_region_resource(Region *region) noexcept : region_(region) {}
+  Region *region() const noexcept { return region_; }
+
+protected:
+  void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+    void *ptr = my_region_aligned_alloc(region_, alignment, bytes == 0 ? 1 : bytes);
+    if (ptr == nullptr)
+      throw std::bad_alloc();
+    return ptr;
+  }
+
+  void do_deallocate(void *, std::size_t, std::size_t) override {}
+
+  bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+    auto *resource = dynamic_cast<const my_region_resource *>(&other);
+    return resource != nullptr && resource->region_ == region_;
+  }
+
+private:
+  Region *region_;
+};
+
+#endif
@@ -0,0 +1,77 @@
+#include "mymalloc.h"
+#include <cstddef>
+#include <new>
+
+/* Replacements for every global operator new / delete, on the my_malloc heap.
+   Build with make newdelete and link src/my_new.o into a C++ program along
+   with the allocator library; programs with several threads need an allocator
+   built with THREADSAFE=1. Sized deletes go to my_free_sized, an alias of
+   my_free: they are no faster than unsized ones. */
+
+namespace {
+
+void *allocate(std::size_t size, std::size_t alignment) {
+  // Every new has to return a distinct pointer, even for 0 bytes
+  if (size == 0)
+    size = 1;
+  for (;;) {
+    void *ptr = alignment > sizeof(std::size_t) ? my_aligned_alloc(alignment, size)
+                                                : my_malloc(size);
+    if (ptr != nullptr)
+      return ptr;
+    std::new_handler handler = std::get_new_handler();
+    if (handler == nullptr)
+      throw std::bad_alloc();
+    handler();
+  }
+}
+
+void *allocate_nothrow(std::size_t size, std::size_t alignment) noexcept {
+  try {
+    return allocate(size, alignment);
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+} // namespace
+
+void *operator new(std::size_t size) { return allocate(size, 0); }
+void *operator new[](std::size_t size) { return allocate(size, 0); }
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  return allocate_nothrow(size, 0);
+}
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  return allocate_nothrow(size, 0);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+  return allocate(size, static_cast<std::size_t>(alignment));
+}
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+  return allocate(size, static_cast<std::size_t>(alignment));
+}
+void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+  return allocate_nothrow(size, static_cast<std::size_t>(alignment));
+}
+void *operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+  return allocate_nothrow(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void *ptr) noexcept { my_free(ptr); }
+void operator delete[](void *ptr) noexcept { my_free(ptr); }
+void operator delete(void *ptr, const std::nothrow_t &) noexcept { my_free(ptr); }
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept { my_free(ptr); }
+void operator delete(void *ptr, std::size_t size) noexcept { my_free_sized(ptr, size); }
+void operator delete[](void *ptr, std::size_t size) noexcept { my_free_sized(ptr, size); }
+
+void operator delete(void *ptr, std::align_val_t) noexcept { my_free(ptr); }
+void operator delete[](void *ptr, std::align_val_t) noexcept { my_free(ptr); }
+void operator delete(void *ptr, std::align_val_t, const std::nothrow_t &) noexcept { my_free(ptr); }
+void operator delete[](void *ptr, std::align_val_t, const std::nothrow_t &) noexcept { my_free(ptr); }
+void operator delete(void *ptr, std::size_t size, std::align_val_t) noexcept {
+  my_free_sized(ptr, size);
+}
+void operator delete[](void *ptr, std::size_t size, std::align_val_t) noexcept {
+  my_free_sized(ptr, size);
+}
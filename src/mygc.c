@@ -1,4 +1,15 @@
+#define _GNU_SOURCE
 #include "mygc.h"
+#include <pthread.h>
+#include <sched.h>
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <link.h>
+#endif
 
 static void *start_of_stack = NULL;
 
@@ -8,31 +19,1169 @@ const size_t kAlignment = sizeof(size_t);
 const size_t kMinAllocationSize = kAlignment;
 // Size of meta-data per Block
 const size_t kMetadataSize = sizeof(Block);
+// Size of allocated meta-data per allocated Block
+const size_t kAllocMetadataSize = sizeof(Tag_t);
 // Maximum allocation size (512 MB)
 const size_t kMaxAllocationSize = (128ull << 20) - kMetadataSize;
 // Memory size that is mmapped (256 MB)
 const size_t kMemorySize = (64ull << 20);
+// Default nursery size in generational mode (4 MB)
+const size_t kNurserySize = (4ull << 20);
+const size_t kMinNurserySize = (64ull << 10);
 
-// Call this function in your test code (at the start of main)
-void set_start_of_stack(void *start_addr) {
-  start_of_stack = start_addr;
+/*  Notes
+    Same boundary-tag blocks as mymalloc, but every arena carries a heap map
+    (see mygc.h) so the collector resolves any word to its Block in
+    O(blocks per page) and keeps mark bits outside the objects.
+*/
+
+// 1. mmap region (each arena owns its free list)
+GcArena * mmap_arena = NULL;
+// 2. Address range spanned by the arenas, rejects most non-heap words early
+static char * heap_lo = NULL;
+static char * heap_hi = NULL;
+
+static GcStats gc_stats;
+
+// Automatic collection policy (see my_gc_set_auto / my_gc_set_trigger)
+static int    gc_auto            = -1;
+static double gc_trigger_ratio   = 1.0;
+static size_t gc_min_trigger     = 8ull << 20;
+static size_t allocated_since_gc = 0;
+
+// Generational mode: young blocks are bump allocated in the nursery arena
+static int       gc_generational = 0;
+static size_t    gc_nursery_size = 0;
+static GcArena * nursery         = NULL;
+static Block   * nursery_hole    = NULL;
+// Set while a minor collection marks and sweeps
+static int       gc_minor        = 0;
+
+// ! Ranges registered with my_gc_add_root
+typedef struct GcRoot {
+  void * start;
+  size_t len;
+} GcRoot;
+
+static struct {
+  GcRoot * items;
+  size_t   top;
+  size_t   cap;
+} gc_roots;
+
+// Grey blocks a worker buffers before spilling to its shared stack
+#define GC_LOCAL_SLOTS 64
+// Most blocks moved by one steal
+#define GC_STEAL_BATCH 256
+// Blocks popped (and prefetched) ahead of the one being scanned
+#define GC_PREFETCH_DEPTH 8
+// Default bound on the entries of one shared mark stack
+#define GC_MARK_STACK_MAX (1ul << 20)
+
+// ! Explicit mark stack, grown with mmap up to gc_stack_limit entries so deep
+//   structures never recurse. Each worker owns one; thieves take from the
+//   bottom under `lock`.
+typedef struct MarkStack {
+  Block ** items;
+  size_t   top;
+  size_t   cap;
+  pthread_mutex_t lock;
+} MarkStack;
+
+typedef struct GcWorker {
+  // Private buffer in front of the shared stack, so most pushes and pops
+  // take no lock
+  Block *   local[GC_LOCAL_SLOTS];
+  size_t    n_local;
+  // Popped blocks waiting for their prefetch to land, oldest at fifo_head
+  Block *   fifo[GC_PREFETCH_DEPTH];
+  size_t    fifo_head;
+  size_t    n_fifo;
+  MarkStack stack;
+  pthread_t thread;
+  // Bytes this worker marked, then blocks kept / released by its sweeps
+  size_t    marked_bytes;
+  GcStats   swept;
+} GcWorker;
+
+static GcWorker  gc_workers[GC_MAX_THREADS];
+// Configured marker count (0 until my_gc_set_threads or MYGC_THREADS)
+static int       gc_threads = 0;
+// Workers taking part in the current phase / workers out of work
+static int       gc_active  = 1;
+static int       gc_idle    = 0;
+// Set while marking: helper threads wait on it before sweeping
+static int       gc_marking = 0;
+// A full mark stack dropped a grey block: marked blocks must be rescanned
+static int       gc_overflow = 0;
+static size_t    gc_stack_limit = GC_MARK_STACK_MAX;
+// Sweep arenas on demand from my_malloc instead of inside my_gc
+static int       gc_lazy_sweep = -1;
+// Arenas still flagged by the last collection
+static size_t    unswept_arenas = 0;
+// Next arena to sweep
+static GcArena * sweep_cursor = NULL;
+static pthread_mutex_t sweep_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t  gc_once    = PTHREAD_ONCE_INIT;
+
+#define GRANULE(arena, ptr) \
+  ((size_t) ((char *) (ptr) - (char *) (arena)) >> GC_GRANULE_SHIFT)
+
+static GcArena * memoryAllocation(size_t size);
+static void insertNode(GcArena * arena, Block * b);
+static void removeNode(GcArena * arena, Block * b);
+static void insert_bound_tag(Block * node);
+static void coalesce(GcArena * arena, Block * node);
+static int sweep_next_arena(void);
+static void gc_policy_init(void);
+static void nursery_reset(void);
+static void clear_cards(void);
+
+static size_t memAlign(size_t chunk, size_t alignment){
+  return (chunk + alignment - 1) & ~(alignment - 1);
 }
 
-void *my_malloc(size_t size) {
+static inline void bit_set(uint64_t * bits, size_t i){
+  bits[i >> 6] |= 1ull << (i & 63);
+}
+
+static inline void bit_clear(uint64_t * bits, size_t i){
+  bits[i >> 6] &= ~(1ull << (i & 63));
+}
+
+static inline int bit_test(const uint64_t * bits, size_t i){
+  return (bits[i >> 6] >> (i & 63)) & 1;
+}
+
+// ===================================== Heap map =====================================
+
+// ! Bytes of heap map needed for an arena of `size` bytes
+static size_t map_bytes(size_t size){
+  size_t bitmap = (size >> (GC_GRANULE_SHIFT + 6)) * sizeof(uint64_t);
+  size_t cover  = (size >> GC_PAGE_SHIFT) * sizeof(uint32_t);
+  size_t cards  = size >> GC_CARD_SHIFT;
+  return (bitmap << 1) + cover + cards;
+}
+
+static size_t arena_header_size(size_t size){
+  return memAlign(sizeof(GcArena) + map_bytes(size), kAlignment << 1);
+}
+
+static Block * arena_first_block(GcArena * arena){
+  return (Block *) ((char *) arena + arena_header_size(arena->size) + kMetadataSize);
+}
+
+// ! Smallest arena whose free region holds `required` bytes
+static size_t arena_size_for(size_t required){
+  size_t size = kMemorySize;
+  while (size - arena_header_size(size) - (kMetadataSize << 1) < required)
+      size <<= 1;
+  return size;
+}
+
+static GcArena * find_arena(const void * ptr){
+  const char * p = ptr;
+  if (p < heap_lo || p >= heap_hi)
+      return NULL;
+  for (GcArena * arena = mmap_arena; arena; arena = arena->next){
+      if (p >= (char *) arena && p < (char *) arena + arena->size)
+          return arena;
+  }
   return NULL;
 }
 
+// ! Record a newly allocated block: start bit + every page start it spans
+static void map_insert(GcArena * arena, Block * block){
+  size_t off = (char *) block - (char *) arena;
+  size_t end = off + block_size(block);
+  bit_set(arena->map.starts, off >> GC_GRANULE_SHIFT);
+  for (size_t page = (off >> GC_PAGE_SHIFT) + 1; (page << GC_PAGE_SHIFT) < end; page++)
+      arena->map.cover[page] = (uint32_t) off;
+}
+
+static void map_remove(GcArena * arena, Block * block){
+  size_t off = (char *) block - (char *) arena;
+  size_t end = off + block_size(block);
+  bit_clear(arena->map.starts, off >> GC_GRANULE_SHIFT);
+  bit_clear(arena->map.marks, off >> GC_GRANULE_SHIFT);
+  for (size_t page = (off >> GC_PAGE_SHIFT) + 1; (page << GC_PAGE_SHIFT) < end; page++)
+      arena->map.cover[page] = GC_NO_BLOCK;
+}
+
+/* Returns the allocated block of `arena` containing `ptr`, or NULL. Only the
+   start bits of ptr's own page are scanned (at most 8 words); a block that
+   begins on an earlier page is found through the page's cover entry. */
+static Block * find_block_in(GcArena * arena, const void * ptr){
+  size_t   off        = (const char *) ptr - (char *) arena;
+  size_t   granule    = off >> GC_GRANULE_SHIFT;
+  size_t   first_word = (off >> GC_PAGE_SHIFT) << (GC_PAGE_SHIFT - GC_GRANULE_SHIFT - 6);
+  size_t   word       = granule >> 6;
+  uint64_t bits       = arena->map.starts[word] & (~0ull >> (63 - (granule & 63)));
+  Block *  block      = NULL;
+
+  for (;;){
+      if (bits){
+          size_t start = (word << 6) + 63 - __builtin_clzll(bits);
+          block = (Block *) ((char *) arena + (start << GC_GRANULE_SHIFT));
+          break;
+      }
+      if (word == first_word)
+          break;
+      bits = arena->map.starts[--word];
+  }
+  if (block == NULL){
+      uint32_t cover = arena->map.cover[off >> GC_PAGE_SHIFT];
+      if (cover == GC_NO_BLOCK)
+          return NULL;
+      block = (Block *) ((char *) arena + cover);
+  }
+  // Pointers into the first bytes of a block (nearly all of them) are inside
+  // it whatever its size, so its header is not read until it is scanned
+  if ((const char *) ptr - (char *) block < (ptrdiff_t) (kMinAllocationSize + kMetadataSize))
+      return block;
+  if ((const char *) ptr >= (char *) block + block_size(block))
+      return NULL;
+  return block;
+}
+
+// ===================================== Allocator ====================================
+
+// ! Best fit over the free lists of every arena
+static void * searchBlock(size_t required_size){
+  GcArena * best_arena = NULL;
+  Block   * best       = NULL;
+
+  for (GcArena * arena = mmap_arena; arena && (!best || block_size(best) != required_size); arena = arena->next){
+      // Free lists of unswept arenas miss the garbage found by the last
+      // collection, the nursery is only bump allocated
+      if (arena->needs_sweep || arena->young)
+          continue;
+      for (Block * node = arena->freeList; node; node = node->next){
+          if (block_size(node) >= required_size && (!best || block_size(node) < block_size(best))){
+              best       = node;
+              best_arena = arena;
+              if (block_size(best) == required_size)
+                  break;
+          }
+      }
+  }
+  if (best == NULL)
+      return NULL;
+
+  removeNode(best_arena, best);
+  // ! Leftover > Minimum Size (Split)
+  size_t leftover = block_size(best) - required_size;
+  if (leftover >= kMinAllocationSize + kMetadataSize){
+      Block * nBlock = (Block *) ((char *) best + required_size);
+      nBlock->size   = leftover;
+      insert_bound_tag(nBlock);
+      insertNode(best_arena, nBlock);
+      best->size     = required_size;
+  }
+  SET_ALLOC_BIT(best);
+  insert_bound_tag(best);
+  map_insert(best_arena, best);
+  return (void *) ((char *) best + kAllocMetadataSize);
+}
+
+// ! Internal function to mmap an arena and lay down its heap map
+static GcArena * memoryAllocation(size_t size){
+  GcArena * region = (GcArena *) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  if (region == MAP_FAILED)
+      return NULL;
+
+  Block * startfence = (Block *) ((char *) region + arena_header_size(size));
+  Block * endfence   = (Block *) ((char *) region + size - kMetadataSize);
+  Block * freeregion = (Block *) ((char *) startfence + kMetadataSize);
+
+  // ! 1. Heap map (mmap hands the bitmaps back zeroed)
+  region->size        = size;
+  region->freeList    = NULL;
+  region->needs_sweep = 0;
+  region->young       = 0;
+  region->dirty       = 0;
+  region->map.n_pages = size >> GC_PAGE_SHIFT;
+  region->map.starts  = (uint64_t *) (region + 1);
+  region->map.marks   = region->map.starts + (size >> (GC_GRANULE_SHIFT + 6));
+  region->map.cover   = (uint32_t *) (region->map.marks + (size >> (GC_GRANULE_SHIFT + 6)));
+  region->map.cards   = (uint8_t *) (region->map.cover + region->map.n_pages);
+  memset(region->map.cover, 0xff, region->map.n_pages * sizeof(uint32_t));
+
+  // ! 2. Fences
+  startfence->size = kMetadataSize;
+  SET_ALLOC_BIT(startfence);
+  insert_bound_tag(startfence);
+  endfence->size   = kMetadataSize;
+  SET_ALLOC_BIT(endfence);
+  insert_bound_tag(endfence);
+
+  // ! 3. Free region
+  freeregion->size = (char *) endfence - (char *) freeregion;
+  insert_bound_tag(freeregion);
+  insertNode(region, freeregion);
+
+  region->next = mmap_arena;
+  mmap_arena   = region;
+  if (heap_lo == NULL || (char *) region < heap_lo)
+      heap_lo = (char *) region;
+  if ((char *) region + size > heap_hi)
+      heap_hi = (char *) region + size;
+  gc_stats.heap_bytes += size;
+  gc_stats.arenas++;
+  return region;
+}
+
+// ===================================== Nursery ======================================
+
+// ! Bump allocation through the holes of the nursery, in free-list order
+static void * nursery_alloc(size_t required_size){
+  while (nursery_hole){
+      Block * block = nursery_hole;
+      if (block_size(block) < required_size){
+          // Too small: left alone until the next collection merges it
+          nursery_hole = block->next;
+          continue;
+      }
+      size_t leftover = block_size(block) - required_size;
+      if (leftover >= kMinAllocationSize + kMetadataSize){
+          Block * rest = (Block *) ((char *) block + required_size);
+          rest->next   = block->next;
+          rest->size   = leftover;
+          insert_bound_tag(rest);
+          nursery_hole = rest;
+          block->size  = required_size;
+      }
+      else nursery_hole = block->next;
+      SET_ALLOC_BIT(block);
+      insert_bound_tag(block);
+      map_insert(nursery, block);
+      return (void *) ((char *) block + kAllocMetadataSize);
+  }
+  return NULL;
+}
+
+/* Called right after the nursery was swept. A nursery that is mostly promoted
+   survivors (or generational mode being switched off) retires into the old
+   heap, its free list becoming an ordinary one, and a fresh nursery is mapped
+   on the next young allocation. */
+static void nursery_reset(void){
+  clear_cards();
+  if (nursery == NULL)
+      return;
+  size_t occupied = 0;
+  for (Block * hole = nursery->freeList; hole; hole = hole->next)
+      occupied += block_size(hole);
+  occupied = nursery->size - occupied;
+  if (!gc_generational || occupied > (nursery->size >> 1)){
+      nursery->young = 0;
+      nursery        = NULL;
+      nursery_hole   = NULL;
+      return;
+  }
+  nursery_hole = nursery->freeList;
+}
+
+static void * young_alloc(size_t required_size){
+  if (nursery == NULL){
+      nursery = memoryAllocation(gc_nursery_size);
+      if (nursery == NULL)
+          return NULL;
+      nursery->young = 1;
+      nursery_hole   = nursery->freeList;
+  }
+  void * ptr = nursery_alloc(required_size);
+  if (ptr == NULL && start_of_stack){
+      my_gc_minor();
+      if (nursery)
+          ptr = nursery_alloc(required_size);
+  }
+  return ptr;
+}
+
+void my_gc_set_generational(int enabled, size_t nursery_size) {
+  if (gc_auto < 0)
+      gc_policy_init();
+  gc_generational = enabled != 0;
+  if (nursery_size)
+      gc_nursery_size = memAlign(nursery_size < kMinNurserySize ? kMinNurserySize : nursery_size, GC_PAGE_SIZE);
+}
+
+void *my_malloc(size_t size) {
+  if (size == 0)
+      return NULL;
+
+  if (size < kMinAllocationSize)
+      size = kMinAllocationSize;
+  size_t target_size = memAlign(size, kAlignment);
+
+  if (target_size > kMaxAllocationSize)
+      return NULL;
+
+  size_t user_request_size  = target_size + (kAllocMetadataSize << 1);
+  size_t minimum_alloc_size = kMinAllocationSize + kMetadataSize;
+  size_t required_size      = user_request_size > minimum_alloc_size ? user_request_size : minimum_alloc_size;
+
+  // ! Automatic collection once enough has been allocated since the last one
+  if (gc_auto < 0)
+      gc_policy_init();
+  if (gc_auto && start_of_stack){
+      size_t threshold = (size_t) (gc_trigger_ratio * gc_stats.marked_bytes);
+      if (allocated_since_gc >= (threshold > gc_min_trigger ? threshold : gc_min_trigger))
+          my_gc();
+  }
+
+  // ! Generational mode: small blocks are born in the nursery
+  void * ptr = NULL;
+  if (gc_generational && required_size <= gc_nursery_size >> 3){
+      ptr = young_alloc(required_size);
+      if (ptr)
+          return ptr;
+  }
+
+  ptr = searchBlock(required_size);
+  // ! Lazy sweep: reclaim just enough of the last collection's garbage
+  while (ptr == NULL && sweep_next_arena())
+      ptr = searchBlock(required_size);
+
+  // ! Collect before growing the heap, unless nothing new was allocated
+  if (ptr == NULL && gc_auto && start_of_stack && allocated_since_gc >= gc_min_trigger){
+      my_gc();
+      do
+          ptr = searchBlock(required_size);
+      while (ptr == NULL && sweep_next_arena());
+  }
+  if (ptr == NULL){
+      if (memoryAllocation(arena_size_for(required_size)) == NULL)
+          return NULL;
+      ptr = searchBlock(required_size);
+  }
+  if (ptr)
+      allocated_since_gc += block_size(ptr_to_block(ptr));
+  return ptr;
+}
+
+// ! O(1) coalesce with both neighbours of the same arena
+static void coalesce(GcArena * arena, Block * node){
+  Block * right = (Block *) ((char *) node + block_size(node));
+  if (block_size(right) > kMetadataSize && is_free(right)){
+      removeNode(arena, right);
+      node->size += block_size(right);
+  }
+
+  Tag_t * left_tag  = (Tag_t *) node - 1;
+  size_t  left_size = *left_tag & ~7;
+  Block * left      = (Block *) ((char *) node - left_size);
+  if (left_size > kMetadataSize && is_free(left)){
+      removeNode(arena, left);
+      left->size += block_size(node);
+      node        = left;
+  }
+  insert_bound_tag(node);
+  insertNode(arena, node);
+}
+
 void my_free(void *ptr) {
-  return; 
+  if (!ptr)
+      return;
+  if (((size_t) ptr) & (kAlignment - 1))
+      return;
+
+  // ! Only pointers returned by my_malloc start an allocated block
+  GcArena * arena = find_arena(ptr);
+  Block   * block = ptr_to_block(ptr);
+  if (arena == NULL || find_block_in(arena, ptr) != block)
+      return;
+
+  map_remove(arena, block);
+  block->size = block_size(block);
+  // ! Nursery holes are rebuilt by the next collection
+  if (arena->young){
+      insert_bound_tag(block);
+      return;
+  }
+  coalesce(arena, block);
+}
+
+void *my_malloc_atomic(size_t size) {
+  void * ptr = my_malloc(size);
+  if (ptr){
+      Block * block = ptr_to_block(ptr);
+      SET_ATOMIC_BIT(block);
+      insert_bound_tag(block);
+  }
+  return ptr;
+}
+
+// ===================================== Collector ====================================
+
+// Call this function in your test code (at the start of main)
+void set_start_of_stack(void *start_addr) {
+  start_of_stack = start_addr;
 }
 
+__attribute__((noinline))
 void *get_end_of_stack() {
   return __builtin_frame_address(1);
 }
 
-__attribute__((no_sanitize_address)) // ASan dislikes manual stack unrolling
+void my_gc_set_threads(int threads) {
+  if (threads < 1)
+      threads = 1;
+  gc_threads = threads > GC_MAX_THREADS ? GC_MAX_THREADS : threads;
+}
+
+// ! MYGC_THREADS, else one marker per online CPU
+static int gc_thread_count(void){
+  if (gc_threads == 0){
+      const char * env = getenv("MYGC_THREADS");
+      my_gc_set_threads(env ? atoi(env) : (int) sysconf(_SC_NPROCESSORS_ONLN));
+  }
+  return gc_threads;
+}
+
+static uint64_t now_ns(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// ! Stacks are only shared (and locked) while several workers are marking
+static inline void stack_lock(MarkStack * stack){
+  if (gc_active > 1)
+      pthread_mutex_lock(&stack->lock);
+}
+
+static inline void stack_unlock(MarkStack * stack){
+  if (gc_active > 1)
+      pthread_mutex_unlock(&stack->lock);
+}
+
+// ! Returns 0 when the stack is full and cannot grow any more
+static int mark_stack_push(MarkStack * stack, Block * block){
+  stack_lock(stack);
+  if (stack->top == stack->cap){
+      size_t   cap   = stack->cap ? stack->cap << 1 : GC_PAGE_SIZE;
+      if (cap > gc_stack_limit)
+          cap = gc_stack_limit;
+      Block ** items = cap > stack->cap ? mmap(NULL, cap * sizeof(Block *), PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0) : MAP_FAILED;
+      if (items == MAP_FAILED){
+          stack_unlock(stack);
+          return 0;
+      }
+      if (stack->items){
+          memcpy(items, stack->items, stack->top * sizeof(Block *));
+          munmap(stack->items, stack->cap * sizeof(Block *));
+      }
+      stack->items = items;
+      stack->cap   = cap;
+  }
+  stack->items[stack->top] = block;
+  __atomic_store_n(&stack->top, stack->top + 1, __ATOMIC_RELEASE);
+  stack_unlock(stack);
+  return 1;
+}
+
+static Block * mark_stack_pop(MarkStack * stack){
+  Block * block = NULL;
+  stack_lock(stack);
+  if (stack->top){
+      block = stack->items[stack->top - 1];
+      __atomic_store_n(&stack->top, stack->top - 1, __ATOMIC_RELEASE);
+  }
+  stack_unlock(stack);
+  return block;
+}
+
+/* A grey block that finds no room is dropped: it stays marked but unscanned,
+   and the collector rescans every marked block once the stacks are empty.
+   Its bytes are counted here since it will never be popped. */
+static void mark_overflow(GcWorker * self, Block * block){
+  self->marked_bytes += block_size(block);
+  __atomic_store_n(&gc_overflow, 1, __ATOMIC_RELAXED);
+}
+
+// ! Spill the older half of the private buffer to the shared stack
+static void mark_spill(GcWorker * self){
+  size_t n = (self->n_local + 1) >> 1;
+  for (size_t i = 0; i < n; i++){
+      if (!mark_stack_push(&self->stack, self->local[i]))
+          mark_overflow(self, self->local[i]);
+  }
+  memmove(self->local, self->local + n, (self->n_local - n) * sizeof(Block *));
+  self->n_local -= n;
+}
+
+static inline void mark_push(GcWorker * self, Block * block){
+  if (self->n_local == GC_LOCAL_SLOTS)
+      mark_spill(self);
+  self->local[self->n_local++] = block;
+  // Hand work over as soon as someone is starving
+  if (self->n_local > 1 && __atomic_load_n(&gc_idle, __ATOMIC_RELAXED)
+      && __atomic_load_n(&self->stack.top, __ATOMIC_RELAXED) == 0)
+      mark_spill(self);
+}
+
+static inline Block * mark_pop(GcWorker * self){
+  if (self->n_local)
+      return self->local[--self->n_local];
+  return mark_stack_pop(&self->stack);
+}
+
+// ! Take the older half of another worker's stack (the biggest subgraphs)
+static int mark_steal(GcWorker * self){
+  for (int i = 1; i < gc_active; i++){
+      GcWorker * victim = &gc_workers[(self - gc_workers + i) % gc_active];
+      if (__atomic_load_n(&victim->stack.top, __ATOMIC_ACQUIRE) == 0)
+          continue;
+
+      Block * stolen[GC_STEAL_BATCH];
+      size_t  n = 0;
+      pthread_mutex_lock(&victim->stack.lock);
+      n = (victim->stack.top + 1) >> 1;
+      if (n > GC_STEAL_BATCH)
+          n = GC_STEAL_BATCH;
+      memcpy(stolen, victim->stack.items, n * sizeof(Block *));
+      memmove(victim->stack.items, victim->stack.items + n, (victim->stack.top - n) * sizeof(Block *));
+      __atomic_store_n(&victim->stack.top, victim->stack.top - n, __ATOMIC_RELEASE);
+      pthread_mutex_unlock(&victim->stack.lock);
+
+      for (size_t j = 0; j < n; j++)
+          mark_push(self, stolen[j]);
+      if (n)
+          return 1;
+  }
+  return 0;
+}
+
+// ! Grey the block containing ptr, if it is an allocated block not yet marked
+static inline void mark_ptr(GcWorker * self, const void * ptr){
+  GcArena * arena = find_arena(ptr);
+  if (arena == NULL || (gc_minor && !arena->young))
+      return;
+  Block * block = find_block_in(arena, ptr);
+  if (block == NULL || (gc_minor && IS_OLD(block)))
+      return;
+  size_t   granule = GRANULE(arena, block);
+  uint64_t bit     = 1ull << (granule & 63);
+  if (__atomic_load_n(&arena->map.marks[granule >> 6], __ATOMIC_RELAXED) & bit)
+      return;
+  if (__atomic_fetch_or(&arena->map.marks[granule >> 6], bit, __ATOMIC_RELAXED) & bit)
+      return;
+  // ! Prefetch on grey: the header is only read when the block is scanned
+  __builtin_prefetch(block, 0, 3);
+  mark_push(self, block);
+}
+
+// ! Conservatively treat every aligned word in [lo, hi) as a pointer
+__attribute__((no_sanitize_address))
+static void mark_range(GcWorker * self, const void * lo, const void * hi){
+  const uintptr_t * word = (const uintptr_t *) memAlign((size_t) lo, kAlignment);
+  for (; (const char *) (word + 1) <= (const char *) hi; word++)
+      mark_ptr(self, (const void *) *word);
+}
+
+/* Next grey block to scan. Blocks go through a small FIFO on their way from
+   the mark stack, prefetched as they enter it, so that by the time one is
+   scanned its memory has been in flight for GC_PREFETCH_DEPTH scans. */
+static inline Block * mark_next(GcWorker * self){
+  while (self->n_fifo < GC_PREFETCH_DEPTH){
+      Block * block = mark_pop(self);
+      if (block == NULL)
+          break;
+      __builtin_prefetch(block, 0, 3);
+      self->fifo[(self->fifo_head + self->n_fifo++) % GC_PREFETCH_DEPTH] = block;
+  }
+  if (self->n_fifo == 0)
+      return NULL;
+  Block * block   = self->fifo[self->fifo_head];
+  self->fifo_head = (self->fifo_head + 1) % GC_PREFETCH_DEPTH;
+  self->n_fifo--;
+  return block;
+}
+
+// ! Blacken a block: pointer-free blocks are only accounted for
+static inline void mark_scan(GcWorker * self, Block * block){
+  size_t size = block_size(block);
+  self->marked_bytes += size;
+  if (!IS_ATOMIC(block))
+      mark_range(self, (char *) block + kAllocMetadataSize, (char *) block + size - sizeof(Tag_t));
+}
+
+static int mark_work_available(void){
+  for (int i = 0; i < gc_active; i++){
+      if (__atomic_load_n(&gc_workers[i].stack.top, __ATOMIC_ACQUIRE))
+          return 1;
+  }
+  return 0;
+}
+
+/* Drains the worker's own stack, then steals. Marking is over once every
+   worker is idle: only a busy worker can push, so no grey block is left. */
+static void mark_drain(GcWorker * self){
+  for (;;){
+      Block * block;
+      while ((block = mark_next(self)) != NULL)
+          mark_scan(self, block);
+      if (mark_steal(self))
+          continue;
+
+      __atomic_add_fetch(&gc_idle, 1, __ATOMIC_SEQ_CST);
+      for (;;){
+          if (__atomic_load_n(&gc_idle, __ATOMIC_SEQ_CST) == gc_active)
+              return;
+          if (mark_work_available()){
+              __atomic_sub_fetch(&gc_idle, 1, __ATOMIC_SEQ_CST);
+              break;
+          }
+          sched_yield();
+      }
+  }
+}
+
+/* Recovers from mark stack overflow, with the other workers parked: every
+   marked block is scanned again, which greys the children that were dropped.
+   Repeats until a pass completes without overflowing, returns the passes. */
+static size_t mark_rescan(GcWorker * self){
+  int    active = gc_active;
+  size_t passes = 0;
+  gc_active     = 1;
+  while (gc_overflow){
+      gc_overflow = 0;
+      passes++;
+      for (GcArena * arena = mmap_arena; arena; arena = arena->next){
+          if (gc_minor && !arena->young)
+              continue;
+          size_t n_words = arena->size >> (GC_GRANULE_SHIFT + 6);
+          for (size_t word = 0; word < n_words; word++){
+              for (uint64_t bits = arena->map.marks[word]; bits; bits &= bits - 1){
+                  size_t  granule = (word << 6) + __builtin_ctzll(bits);
+                  Block * block   = (Block *) ((char *) arena + (granule << GC_GRANULE_SHIFT));
+                  if (IS_ATOMIC(block))
+                      continue;
+                  mark_range(self, (char *) block + kAllocMetadataSize, (char *) block + block_size(block) - sizeof(Tag_t));
+                  if (self->n_local || self->stack.top){
+                      gc_idle = 0;
+                      mark_drain(self);
+                  }
+              }
+          }
+      }
+  }
+  gc_idle   = active;
+  gc_active = active;
+  return passes;
+}
+
+#ifdef __linux__
+// ! Writable segments (.data / .bss) of the main program are roots too
+static int mark_data_segments(struct dl_phdr_info * info, size_t size, void * data){
+  for (int i = 0; i < info->dlpi_phnum; i++){
+      const ElfW(Phdr) * phdr = &info->dlpi_phdr[i];
+      if (phdr->p_type == PT_LOAD && (phdr->p_flags & PF_W)){
+          char * start = (char *) info->dlpi_addr + phdr->p_vaddr;
+          mark_range(data, start, start + phdr->p_memsz);
+      }
+  }
+  // The first object reported is the executable itself
+  return 1;
+}
+#endif
+
+// ! Old-to-young pointers recorded by my_gc_write_barrier are roots of a
+//   minor collection. Every young survivor is promoted, so cards are clean
+//   again once the collection is over.
+static void mark_dirty_cards(GcWorker * self){
+  for (GcArena * arena = mmap_arena; arena; arena = arena->next){
+      if (!arena->dirty)
+          continue;
+      size_t n_cards = arena->size >> GC_CARD_SHIFT;
+      for (size_t card = 0; card < n_cards; card++){
+          if (arena->map.cards[card]){
+              char * start = (char *) arena + (card << GC_CARD_SHIFT);
+              mark_range(self, start, start + (1ul << GC_CARD_SHIFT));
+          }
+      }
+  }
+}
+
+static void clear_cards(void){
+  for (GcArena * arena = mmap_arena; arena; arena = arena->next){
+      if (arena->dirty){
+          memset(arena->map.cards, 0, arena->size >> GC_CARD_SHIFT);
+          arena->dirty = 0;
+      }
+  }
+}
+
+void my_gc_write_barrier(void *slot) {
+  if (!gc_generational)
+      return;
+  GcArena * arena = find_arena(slot);
+  if (arena){
+      arena->map.cards[((char *) slot - (char *) arena) >> GC_CARD_SHIFT] = 1;
+      arena->dirty = 1;
+  }
+}
+
+/* Rebuilds the free list of an arena: unmarked allocated blocks are released
+   and merged with the free blocks around them, marked blocks are unmarked.
+   In the nursery the free list doubles as the list of holes to bump into.
+   Arenas share no state, so workers sweep different arenas concurrently. */
+static void sweep_arena(GcArena * arena, GcStats * swept){
+  Block * block = arena_first_block(arena);
+  Block * run   = NULL;
+
+  arena->freeList = NULL;
+  while (block_size(block) > kMetadataSize){
+      size_t  size = block_size(block);
+      Block * next = (Block *) ((char *) block + size);
+
+      if (!is_free(block)){
+          size_t granule = GRANULE(arena, block);
+          int    marked  = bit_test(arena->map.marks, granule);
+          // A minor collection never marks old blocks, they just stay
+          if (marked || (gc_minor && IS_OLD(block))){
+              bit_clear(arena->map.marks, granule);
+              // ! Survivors of the nursery are promoted in place
+              if (arena->young && !IS_OLD(block)){
+                  SET_OLD_BIT(block);
+                  insert_bound_tag(block);
+                  swept->promoted_bytes += size;
+              }
+              swept->live_blocks++;
+              swept->live_bytes += size;
+              if (run){
+                  insert_bound_tag(run);
+                  insertNode(arena, run);
+                  run = NULL;
+              }
+              block = next;
+              continue;
+          }
+          map_remove(arena, block);
+          swept->freed_blocks++;
+          swept->freed_bytes += size;
+      }
+      if (run)
+          run->size += size;
+      else{
+          run       = block;
+          run->size = size;
+      }
+      block = next;
+  }
+  if (run){
+      insert_bound_tag(run);
+      insertNode(arena, run);
+  }
+  if (arena->needs_sweep){
+      arena->needs_sweep = 0;
+      unswept_arenas--;
+  }
+}
+
+static void sweep_drain(GcWorker * self){
+  for (;;){
+      pthread_mutex_lock(&sweep_lock);
+      GcArena * arena = sweep_cursor;
+      if (arena)
+          sweep_cursor = arena->next;
+      pthread_mutex_unlock(&sweep_lock);
+      if (arena == NULL)
+          return;
+      sweep_arena(arena, &self->swept);
+  }
+}
+
+/* Sweeps one arena left over by a lazy collection. Returns 0 when none is
+   left. */
+static int sweep_next_arena(void){
+  if (unswept_arenas == 0)
+      return 0;
+  uint64_t start = now_ns();
+  for (GcArena * arena = mmap_arena; arena; arena = arena->next){
+      if (arena->needs_sweep){
+          sweep_arena(arena, &gc_stats);
+          break;
+      }
+  }
+  gc_stats.sweep_ns += now_ns() - start;
+  return 1;
+}
+
+static void gc_policy_init(void){
+  const char * env = getenv("MYGC_AUTO");
+  gc_auto = env ? atoi(env) != 0 : 1;
+  if ((env = getenv("MYGC_TRIGGER_RATIO")) != NULL)
+      gc_trigger_ratio = atof(env);
+  if ((env = getenv("MYGC_MIN_TRIGGER")) != NULL)
+      gc_min_trigger = strtoull(env, NULL, 0);
+  if ((env = getenv("MYGC_GENERATIONAL")) != NULL)
+      gc_generational = atoi(env) != 0;
+  env = getenv("MYGC_NURSERY_SIZE");
+  my_gc_set_generational(gc_generational, env ? strtoull(env, NULL, 0) : kNurserySize);
+}
+
+void my_gc_set_auto(int enabled) {
+  if (gc_auto < 0)
+      gc_policy_init();
+  gc_auto = enabled != 0;
+}
+
+void my_gc_set_trigger(double ratio, size_t min_bytes) {
+  if (gc_auto < 0)
+      gc_policy_init();
+  gc_trigger_ratio = ratio;
+  gc_min_trigger   = min_bytes;
+}
+
+void my_gc_set_lazy_sweep(int lazy) {
+  gc_lazy_sweep = lazy != 0;
+}
+
+void my_gc_finish_sweep(void) {
+  while (sweep_next_arena())
+      ;
+}
+
+static void gc_init_workers(void){
+  for (int i = 0; i < GC_MAX_THREADS; i++)
+      pthread_mutex_init(&gc_workers[i].stack.lock, NULL);
+  const char * env = getenv("MYGC_MARK_STACK_LIMIT");
+  if (env && strtoull(env, NULL, 0) > 0)
+      gc_stack_limit = strtoull(env, NULL, 0);
+}
+
+void my_gc_add_root(void *ptr, size_t len) {
+  if (gc_roots.top == gc_roots.cap){
+      size_t   cap   = gc_roots.cap ? gc_roots.cap << 1 : GC_PAGE_SIZE / sizeof(GcRoot);
+      GcRoot * items = mmap(NULL, cap * sizeof(GcRoot), PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+      if (items == MAP_FAILED){
+          printf("[my_gc]: Unable to grow the root table\n");
+          return;
+      }
+      if (gc_roots.items){
+          memcpy(items, gc_roots.items, gc_roots.top * sizeof(GcRoot));
+          munmap(gc_roots.items, gc_roots.cap * sizeof(GcRoot));
+      }
+      gc_roots.items = items;
+      gc_roots.cap   = cap;
+  }
+  gc_roots.items[gc_roots.top].start = ptr;
+  gc_roots.items[gc_roots.top].len   = len;
+  gc_roots.top++;
+}
+
+void my_gc_remove_root(void *ptr) {
+  for (size_t i = 0; i < gc_roots.top; i++){
+      if (gc_roots.items[i].start == ptr){
+          gc_roots.items[i] = gc_roots.items[--gc_roots.top];
+          return;
+      }
+  }
+}
+
+static void * gc_worker_main(void * arg){
+  GcWorker * self = arg;
+  mark_drain(self);
+  // The first worker may still be recovering from an overflow
+  while (__atomic_load_n(&gc_marking, __ATOMIC_ACQUIRE))
+      sched_yield();
+  sweep_drain(self);
+  return NULL;
+}
+
+/* Root scan, parallel mark and sweep shared by my_gc and my_gc_minor. A minor
+   collection only traces young blocks of the nursery, starting from the
+   usual roots plus the dirty cards of every arena, and only sweeps the
+   nursery; its survivors are promoted in place. */
+__attribute__((noinline, no_sanitize_address)) // ASan dislikes manual stack unrolling
+static void collect(int minor){
+  uint64_t start   = now_ns();
+  int      threads = gc_thread_count();
+  if (gc_lazy_sweep < 0){
+      const char * env = getenv("MYGC_LAZY_SWEEP");
+      gc_lazy_sweep = env ? atoi(env) != 0 : 1;
+  }
+
+  // ! Spill callee-saved registers so they are scanned along with the stack
+  jmp_buf regs;
+  memset(regs, 0, sizeof(regs));
+  setjmp(regs);
+  void *end_of_stack = (void *) regs;
+
+  // ! 1. Roots go to the first worker, the others steal from it
+  pthread_once(&gc_once, gc_init_workers);
+  for (int i = 0; i < threads; i++){
+      gc_workers[i].marked_bytes = 0;
+      memset(&gc_workers[i].swept, 0, sizeof(GcStats));
+  }
+  gc_minor    = minor;
+  gc_active   = 1;
+  gc_idle     = 0;
+  gc_marking  = 1;
+  gc_overflow = 0;
+  mark_range(&gc_workers[0], end_of_stack, start_of_stack);
+  for (size_t i = 0; i < gc_roots.top; i++)
+      mark_range(&gc_workers[0], gc_roots.items[i].start, (char *) gc_roots.items[i].start + gc_roots.items[i].len);
+#ifdef __linux__
+  // Registered roots replace the conservative scan of the data segment
+  if (gc_roots.top == 0)
+      dl_iterate_phdr(mark_data_segments, &gc_workers[0]);
+#endif
+  if (minor)
+      mark_dirty_cards(&gc_workers[0]);
+
+  // ! 2. Parallel mark, then parallel sweep (one arena per worker at a time)
+  //      unless sweeping is left to my_malloc
+  gc_active    = threads;
+  sweep_cursor = gc_lazy_sweep || minor ? NULL : mmap_arena;
+  for (int i = 1; i < threads; i++){
+      if (pthread_create(&gc_workers[i].thread, NULL, gc_worker_main, &gc_workers[i]) != 0){
+          // Workers that never started just stay idle
+          __atomic_add_fetch(&gc_idle, 1, __ATOMIC_SEQ_CST);
+          gc_workers[i].thread = 0;
+      }
+  }
+  mark_drain(&gc_workers[0]);
+  gc_stats.rescans = gc_overflow ? mark_rescan(&gc_workers[0]) : 0;
+  __atomic_store_n(&gc_marking, 0, __ATOMIC_RELEASE);
+  uint64_t marked = now_ns();
+  sweep_drain(&gc_workers[0]);
+  for (int i = 1; i < threads; i++){
+      if (gc_workers[i].thread)
+          pthread_join(gc_workers[i].thread, NULL);
+  }
+  gc_active = 1;
+
+  // ! 3. The nursery is always swept right away so bump allocation can resume
+  //      (kept: nursery_reset may retire it, it must not be swept lazily)
+  GcStats   swept         = {0};
+  GcArena * swept_nursery = nursery;
+  if (nursery && (minor || gc_lazy_sweep))
+      sweep_arena(nursery, &swept);
+  for (int i = 0; i < threads; i++){
+      swept.marked_bytes += gc_workers[i].marked_bytes;
+      swept.live_blocks  += gc_workers[i].swept.live_blocks;
+      swept.live_bytes   += gc_workers[i].swept.live_bytes;
+      swept.freed_blocks += gc_workers[i].swept.freed_blocks;
+      swept.freed_bytes  += gc_workers[i].swept.freed_bytes;
+      swept.promoted_bytes += gc_workers[i].swept.promoted_bytes;
+  }
+  gc_minor = 0;
+  nursery_reset();
+
+  if (minor){
+      gc_stats.minor_collections++;
+      gc_stats.promoted_bytes = swept.promoted_bytes;
+      gc_stats.minor_ns       = now_ns() - start;
+      // Promoted survivors count towards the next full collection
+      allocated_since_gc     += swept.promoted_bytes;
+      return;
+  }
+  gc_stats.live_blocks  = swept.live_blocks;
+  gc_stats.live_bytes   = swept.live_bytes;
+  gc_stats.freed_blocks = swept.freed_blocks;
+  gc_stats.freed_bytes  = swept.freed_bytes;
+  gc_stats.marked_bytes = swept.marked_bytes;
+  if (gc_lazy_sweep){
+      for (GcArena * arena = mmap_arena; arena; arena = arena->next){
+          if (arena != swept_nursery){
+              arena->needs_sweep = 1;
+              unswept_arenas++;
+          }
+      }
+  }
+  gc_stats.threads  = threads;
+  gc_stats.mark_ns  = marked - start;
+  allocated_since_gc = 0;
+  gc_stats.sweep_ns = now_ns() - marked;
+  gc_stats.collections++;
+}
+
 void my_gc() {
-  void *end_of_stack = get_end_of_stack();
+  if (start_of_stack == NULL || mmap_arena == NULL)
+      return;
+  // ! Marks of the previous cycle must be gone before marking again
+  my_gc_finish_sweep();
+  collect(0);
+}
+
+void my_gc_minor(void) {
+  if (start_of_stack == NULL || nursery == NULL)
+      return;
+  collect(1);
+}
+
+void my_gc_get_stats(GcStats *stats) {
+  *stats = gc_stats;
+  stats->unswept_arenas = unswept_arenas;
+}
+
+/** These are helper functions you are required to implement for internal testing
+ *  purposes. Depending on the optimisations you implement, you will need to
+ *  update these functions yourself.
+ **/
+
+/* Returns 1 if the given block is free, 0 if not. */
+int is_free(Block *block) {
+  return (block->size & 1) == 0;
+}
+
+/* Returns the size of the given block */
+size_t block_size(Block *block) {
+  return GET_SIZE(block);
+}
+
+/* Returns the first block in memory (excluding fenceposts) */
+Block *get_start_block(void) {
+  if (!mmap_arena) return NULL;
+  return arena_first_block(mmap_arena);
+}
+
+/* Returns the next block in memory */
+Block *get_next_block(Block *block) {
+  if (!block) return NULL;
+
+  Block * next_block = (Block *) ((char *) block + block_size(block));
+  if (block_size(next_block) <= kMetadataSize){
+      GcArena * arena = find_arena(block);
+      if (arena && arena->next)
+          return arena_first_block(arena->next);
+      return NULL;
+  }
+  return next_block;
+}
+
+/* Given a ptr assumed to be returned from a previous call to `malloc`,
+   return a pointer to the start of the metadata block. */
+Block *ptr_to_block(void *ptr) {
+  return ADD_BYTES(ptr, -((ssize_t) kAllocMetadataSize));
+}
+
+static void insertNode(GcArena * arena, Block * b){
+  b->prev = NULL;
+  b->next = arena->freeList;
+  if (arena->freeList)
+      arena->freeList->prev = b;
+  arena->freeList = b;
+}
+
+static void removeNode(GcArena * arena, Block * b){
+  if (b->prev) b->prev->next = b->next;
+  if (b->next) b->next->prev = b->prev;
+  if (b == arena->freeList){
+      arena->freeList = b->next;
+      if (arena->freeList) arena->freeList->prev = NULL;
+  }
+  b->next = b->prev = NULL;
+}
+
+static void insert_bound_tag(Block * node){
+  size_t size    = block_size(node);
+  Tag_t * Header = (Tag_t *) node;
+  *Header = node->size;
 
-  // TODO
+  Tag_t * Footer = (Tag_t *) ((char *) node + size - sizeof(Tag_t));
+  *Footer = node->size;
 }
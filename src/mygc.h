@@ -3,9 +3,126 @@
 
 #include "mymalloc.h"
 #include <stddef.h>
+#include <stdint.h>
+
+// Pages indexed by the heap map (4 KB)
+#define GC_PAGE_SHIFT 12
+#define GC_PAGE_SIZE (1ul << GC_PAGE_SHIFT)
+// One bit of the start / mark bitmaps covers one granule (kAlignment bytes)
+#define GC_GRANULE_SHIFT 3
+// Upper bound on marking / sweeping threads
+#define GC_MAX_THREADS 64
+// Spare size-tag bit: the block holds no pointers and is never scanned
+#define GC_ATOMIC_BIT 2
+#define SET_ATOMIC_BIT(ptr) (ptr->size |= GC_ATOMIC_BIT)
+#define IS_ATOMIC(ptr) (ptr->size & GC_ATOMIC_BIT)
+// Spare size-tag bit: the block survived a collection (generational mode)
+#define GC_OLD_BIT 4
+#define SET_OLD_BIT(ptr) (ptr->size |= GC_OLD_BIT)
+#define IS_OLD(ptr) (ptr->size & GC_OLD_BIT)
+// One card byte per 512 bytes of arena, set by my_gc_write_barrier
+#define GC_CARD_SHIFT 9
+// Cover entry of a page whose first byte is not inside an allocated block
+#define GC_NO_BLOCK UINT32_MAX
+
+/** Side table indexing one arena. It lives at the front of the arena, outside
+ *  of every Block, so marking never writes into user objects and an interior
+ *  pointer is resolved without walking the block list:
+ *    - starts: bit set at the first granule of every allocated Block
+ *    - marks:  bit set at the first granule of every Block reached by my_gc
+ *    - cover:  per page, offset of the allocated Block spanning the page start
+ *    - cards:  per card, set when a pointer may have been stored there
+ **/
+typedef struct HeapMap {
+  uint64_t *starts;
+  uint64_t *marks;
+  uint32_t *cover;
+  uint8_t  *cards;
+  size_t    n_pages;
+} HeapMap;
+
+/** Arena used by the collector. Every arena keeps its own free list so that it
+ *  can be swept without touching the others. **/
+typedef struct GcArena {
+  size_t size;
+  struct GcArena *next;
+  Block *freeList;
+  // Marked by the last collection but not swept yet (lazy sweeping)
+  int needs_sweep;
+  // Nursery of the generational mode / has dirty cards
+  int young;
+  int dirty;
+  HeapMap map;
+} GcArena;
+
+typedef struct GcStats {
+  // Number of completed calls to my_gc
+  size_t collections;
+  // Arenas / bytes mapped for arenas (including the heap map)
+  size_t arenas;
+  size_t heap_bytes;
+  // Arenas whose garbage has not been swept yet
+  size_t unswept_arenas;
+  // Allocated blocks / bytes that survived the last collection. With lazy
+  // sweeping these grow as arenas get swept.
+  size_t live_blocks;
+  size_t live_bytes;
+  // Bytes reached by the last mark (drives automatic collections)
+  size_t marked_bytes;
+  // Blocks / bytes reclaimed by the last collection
+  size_t freed_blocks;
+  size_t freed_bytes;
+  // Threads used and time spent in each phase of the last collection
+  int      threads;
+  uint64_t mark_ns;
+  uint64_t sweep_ns;
+  // Passes over the marked blocks after the mark stack overflowed
+  size_t   rescans;
+  // Minor collections, bytes promoted by / time taken by the last one
+  size_t   minor_collections;
+  size_t   promoted_bytes;
+  uint64_t minor_ns;
+} GcStats;
 
 void set_start_of_stack(void *start_addr);
 void *get_end_of_stack(void);
 void my_gc(void);
+/* Like my_malloc, but the collector never looks inside the block (numeric
+   buffers, strings). It is still freed when unreachable. */
+void *my_malloc_atomic(size_t size);
+/* Scan [ptr, ptr + len) for pointers on every collection. Once a root is
+   registered, only the stack and the registered ranges are roots: the data
+   segment of the program is no longer scanned as a whole. */
+void my_gc_add_root(void *ptr, size_t len);
+void my_gc_remove_root(void *ptr);
+void my_gc_get_stats(GcStats *stats);
+/* Number of threads marking and sweeping in my_gc. Defaults to $MYGC_THREADS,
+   or one per online CPU. Each has a mark stack of at most
+   $MYGC_MARK_STACK_LIMIT entries (1M by default); past that, marking falls
+   back to rescanning the marked blocks, slower but needing no memory. */
+void my_gc_set_threads(int threads);
+/* With lazy sweeping (the default, or $MYGC_LAZY_SWEEP=0 to disable) my_gc
+   only marks; arenas are swept one at a time by my_malloc when their free
+   space is needed, or by the next my_gc. */
+void my_gc_set_lazy_sweep(int lazy);
+/* Automatic collections (once set_start_of_stack has been called): my_malloc
+   runs my_gc when the bytes allocated since the last collection reach
+   max(min_bytes, ratio * marked_bytes), and before mapping a new arena.
+   Defaults come from $MYGC_AUTO, $MYGC_TRIGGER_RATIO and $MYGC_MIN_TRIGGER
+   (enabled, 1.0, 8 MB). */
+void my_gc_set_auto(int enabled);
+void my_gc_set_trigger(double ratio, size_t min_bytes);
+void my_gc_finish_sweep(void);
+/* Generational mode: blocks up to nursery_size / 8 are bump allocated in a
+   nursery (4 MB by default). When it fills up, my_gc_minor traces the young
+   blocks only and promotes the survivors in place. Pointer stores into blocks
+   that may be old must then be followed by my_gc_write_barrier(slot), or be
+   made through MY_GC_WRITE. Defaults come from $MYGC_GENERATIONAL and
+   $MYGC_NURSERY_SIZE (disabled, 4 MB). */
+void my_gc_set_generational(int enabled, size_t nursery_size);
+void my_gc_minor(void);
+void my_gc_write_barrier(void *slot);
+#define MY_GC_WRITE(slot, value) \
+  do { *(slot) = (value); my_gc_write_barrier((void *) (slot)); } while (0)
 
 #endif
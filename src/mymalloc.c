@@ -1,4 +1,12 @@
 #include "mymalloc.h"
+#include "size_classes.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(SIMD_SCAN) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
 
 // Word alignment
 const size_t kAlignment = sizeof(size_t);
@@ -8,77 +16,299 @@ const size_t kMinAllocationSize = kAlignment;
 const size_t kMetadataSize = sizeof(Block);
 // Size of allocated meta-data per allocated Block
 const size_t kAllocMetadataSize = sizeof(Tag_t);
-// Maximum allocation size (512 MB)
-const size_t kMaxAllocationSize = (512ull << 20) - kMetadataSize;
+// Smallest block: free-block metadata and a footer
+const size_t kMinBlockSize = sizeof(Block) + sizeof(Tag_t);
+// Maximum allocation size (512 MB), a multiple of the alignment
+const size_t kMaxAllocationSize = (512ull << 20) - ((sizeof(Block) + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1));
 // Memory size that is mmapped (256 MB)
 const size_t kMemorySize = (256ull << 20);
+// Default chunk size of a region (64 KB)
+const size_t kRegionChunkSize = (64ull << 10);
+// Chunk size of a pool, and largest pool object (64 KB)
+const size_t kPoolChunkSize = (64ull << 10);
+
+#ifdef SMALL_HEAP
+// Address space reserved per heap; arenas are carved from it (4 GB)
+static const size_t kHeapReserve = (4ull << 30);
+// Blocks start at 4 mod 8, so that payloads after a 4-byte header are word
+// aligned: the start fence is pushed by 4 bytes and the end fence pulled by 4
+static const size_t kFenceSize    = 8;
+static const size_t kArenaPadding = 4;
+// ! Block <-> offset from the heap's base (never 0: the arena header is there)
+#define BLOCK_REF(heap, b) ((b) ? (BlockRef) ((char *) (b) - (heap)->base) : 0)
+#define REF_BLOCK(heap, r) ((r) ? (Block *) ((heap)->base + (r)) : NULL)
+#else
+static const size_t kFenceSize    = sizeof(Block);
+static const size_t kArenaPadding = 0;
+#define BLOCK_REF(heap, b) (b)
+#define REF_BLOCK(heap, r) (r)
+#endif
 
 /*  Notes
     Constant-time Coelesce
+    Wilderness: the untouched tail of the newest arena is not on the free
+    list. It is served by a bump pointer once the free list has no fit, and
+    a freed block next to it is merged back into it.
+    Segregated fit: free blocks sit in one list per size class, best fit is
+    searched in the request's class and then in the next non-empty one.
+    Heaps: every piece of state above lives in a Heap; my_malloc / my_free
+    work on a static default heap, my_heap_create makes independent ones.
+    Small heap (SMALL_HEAP=1): 32-bit tags, links as 32-bit offsets from the
+    heap's reservation, which holds every arena of the heap.
 */
 
-// 1. Free block list 
-Block * freeList    = NULL;
-// 2. mmap region
-Arena * mmap_arena  = NULL;
+// ! All the state of one heap; my_malloc / my_free use default_heap
+struct Heap {
+#ifndef SIMD_SCAN
+  // 1. Free lists by size class, and a bitmap of the non-empty ones
+  Block *  freeLists[SIZE_CLASSES];
+  uint64_t freeListBits[(SIZE_CLASSES + 63) / 64];
+#endif
+  // 2. mmap region
+  Arena * mmap_arena;
+  // 3. Wilderness [wilderness, wilderness_end): wilderness_end is the end fence
+  char * wilderness;
+  char * wilderness_end;
+#ifdef SIMD_SCAN
+  // 4. Free blocks as parallel arrays (SIMD_SCAN=1), scanned without chasing
+  //    Block->next. A free block's next field holds its slot + 1, 0 when it is
+  //    not indexed; prev is unused.
+  uint32_t * index_sizes;
+  Block   ** index_blocks;
+  size_t     index_count;
+  size_t     index_cap;
+#endif
+#ifdef THREADSAFE
+  // 5. Held by every call on the heap
+  pthread_mutex_t lock;
+#endif
+  // 6. Set for a heap over a caller's buffer (my_heap_init_static): it never
+  //    maps another arena
+  int fixed;
+#ifdef SMALL_HEAP
+  // 7. Reservation the links are offsets into, and the bytes of it in use
+  //    by arenas (the caller's buffer for a static heap)
+  char * base;
+  size_t reserved;
+#endif
+};
+
+static Heap default_heap = {
+#ifdef THREADSAFE
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+#endif
+};
 
-static void memoryAllocation(size_t size);
-static void removeNode(Block* b);
+static int memoryAllocation(Heap * heap, size_t size);
+static void arenaInit(Heap * heap, Arena * region, size_t size);
+static void removeNode(Heap * heap, Block* b);
+static void insertNode(Heap * heap, Block* b);
 static void insert_bound_tag(Block * node);
-static Block * Left_Coalesce(Block * node);
-static Block * Right_Coalesce(Block * node);
+static Block * Left_Coalesce(Heap * heap, Block * node);
+static Block * Right_Coalesce(Heap * heap, Block * node);
 
 // ! Multiple of 256 MB
 size_t memAlign(size_t chunk, size_t alignment){
   return (chunk + alignment - 1) & ~(alignment - 1);
 }
 
-// ! Traverse free list (Best fit)
-void * searchBlock(size_t size){
-  if (freeList == NULL)
+// ! Header of the wilderness, so that heap walks see it as one free block
+static void wildernessTag(Heap * heap){
+  if (heap->wilderness == heap->wilderness_end)
+      return;
+  Block * w = (Block *) heap->wilderness;
+  w->size   = heap->wilderness_end - heap->wilderness;
+  w->next   = w->prev = 0;
+}
+
+// ! O(1): bump the wilderness pointer
+static void * wildernessAllocation(Heap * heap, size_t required_size){
+  size_t left = heap->wilderness_end - heap->wilderness;
+  if (left < required_size)
       return NULL;
-  Block * node  = freeList;
+  // ! Leftover < Minimum Size (Allocate all)
+  if (left - required_size < kMinBlockSize)
+      required_size = left;
+  Block * block = (Block *) heap->wilderness;
+  block->size   = required_size;
+  SET_ALLOC_BIT(block);
+  insert_bound_tag(block);
+  heap->wilderness += required_size;
+  wildernessTag(heap);
+  return (void *)((char *) block + kAllocMetadataSize);
+}
+
+#ifdef SIMD_SCAN
+/*  Best fit over index_sizes: the smallest size >= required, as a min over
+    lanes where sizes below required are replaced by UINT32_MAX. Returns
+    index_count when nothing fits. Arena sizes stay below 4 GB, so block sizes
+    fit in 32 bits. */
+static size_t scanScalar(const uint32_t * sizes, size_t n, uint32_t required){
+  uint32_t best_size = UINT32_MAX;
+  size_t   best      = n;
+  for (size_t i = 0; i < n; i++)
+      if (sizes[i] >= required && sizes[i] < best_size){
+          best_size = sizes[i];
+          best      = i;
+      }
+  return best;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// ! Index of the first lane equal to best_size, from i on
+static size_t findSize(const uint32_t * sizes, size_t n, size_t i, uint32_t best_size){
+  while (i < n && sizes[i] != best_size)
+      i++;
+  return i;
+}
+
+__attribute__((target("sse4.1")))
+static size_t scanSSE4(const uint32_t * sizes, size_t n, uint32_t required){
+  __m128i req  = _mm_set1_epi32((int) required);
+  __m128i ones = _mm_set1_epi32(-1);
+  __m128i min  = ones;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4){
+      __m128i v    = _mm_loadu_si128((const __m128i *) (sizes + i));
+      // ! v >= required (unsigned) <=> max(v, required) == v
+      __m128i fits = _mm_cmpeq_epi32(_mm_max_epu32(v, req), v);
+      min = _mm_min_epu32(min, _mm_blendv_epi8(ones, v, fits));
+  }
+  min = _mm_min_epu32(min, _mm_shuffle_epi32(min, _MM_SHUFFLE(1, 0, 3, 2)));
+  min = _mm_min_epu32(min, _mm_shuffle_epi32(min, _MM_SHUFFLE(2, 3, 0, 1)));
+  uint32_t best_size = (uint32_t) _mm_cvtsi128_si32(min);
+  size_t tail = scanScalar(sizes + i, n - i, required);
+  if (tail < n - i && sizes[i + tail] < best_size)
+      return i + tail;
+  return best_size == UINT32_MAX ? n : findSize(sizes, n, 0, best_size);
+}
+
+__attribute__((target("avx2")))
+static size_t scanAVX2(const uint32_t * sizes, size_t n, uint32_t required){
+  __m256i req  = _mm256_set1_epi32((int) required);
+  __m256i ones = _mm256_set1_epi32(-1);
+  __m256i min  = ones;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8){
+      __m256i v    = _mm256_loadu_si256((const __m256i *) (sizes + i));
+      __m256i fits = _mm256_cmpeq_epi32(_mm256_max_epu32(v, req), v);
+      min = _mm256_min_epu32(min, _mm256_blendv_epi8(ones, v, fits));
+  }
+  __m128i half = _mm_min_epu32(_mm256_castsi256_si128(min), _mm256_extracti128_si256(min, 1));
+  half = _mm_min_epu32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+  half = _mm_min_epu32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+  uint32_t best_size = (uint32_t) _mm_cvtsi128_si32(half);
+  size_t tail = scanScalar(sizes + i, n - i, required);
+  if (tail < n - i && sizes[i + tail] < best_size)
+      return i + tail;
+  return best_size == UINT32_MAX ? n : findSize(sizes, n, 0, best_size);
+}
+#endif
+
+static size_t scanDispatch(const uint32_t * sizes, size_t n, uint32_t required);
+static size_t (*scanBestFit)(const uint32_t *, size_t, uint32_t) = scanDispatch;
+
+// ! First call picks the widest scan the CPU supports (cpuid)
+static size_t scanDispatch(const uint32_t * sizes, size_t n, uint32_t required){
+  scanBestFit = scanScalar;
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (getenv("MYMALLOC_SCALAR_SCAN") == NULL){
+      if (__builtin_cpu_supports("avx2"))
+          scanBestFit = scanAVX2;
+      else if (__builtin_cpu_supports("sse4.1"))
+          scanBestFit = scanSSE4;
+  }
+#endif
+  return scanBestFit(sizes, n, required);
+}
+
+// ! Doubles the index arrays (mmap: my_malloc cannot be used here)
+static int indexGrow(Heap * heap){
+  size_t cap   = heap->index_cap ? heap->index_cap << 1 : 4096;
+  void * sizes = mmap(NULL, cap * sizeof(uint32_t), PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  void * ptrs  = mmap(NULL, cap * sizeof(Block *), PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  if (sizes == MAP_FAILED || ptrs == MAP_FAILED)
+      return 0;
+  if (heap->index_cap){
+      memcpy(sizes, heap->index_sizes, heap->index_count * sizeof(uint32_t));
+      memcpy(ptrs, heap->index_blocks, heap->index_count * sizeof(Block *));
+      munmap(heap->index_sizes, heap->index_cap * sizeof(uint32_t));
+      munmap(heap->index_blocks, heap->index_cap * sizeof(Block *));
+  }
+  heap->index_sizes  = sizes;
+  heap->index_blocks = ptrs;
+  heap->index_cap    = cap;
+  return 1;
+}
+#endif
+
+#ifndef SIMD_SCAN
+// ! First non-empty class >= cls, SIZE_CLASSES if none
+static size_t nextClass(Heap * heap, size_t cls){
+  for (size_t w = cls / 64; w < (SIZE_CLASSES + 63) / 64; w++){
+      uint64_t bits = heap->freeListBits[w];
+      if (w == cls / 64)
+          bits &= ~0ull << (cls % 64);
+      if (bits)
+          return w * 64 + __builtin_ctzll(bits);
+  }
+  return SIZE_CLASSES;
+}
 
-  // ! 1. Traverse free list and find best fit blocks
+// ! Smallest block of at least required_size in one list
+static Block * bestInList(Heap * heap, Block * node, size_t required_size){
   Block * best = NULL;
+  for (; node; node = REF_BLOCK(heap, node->next))
+      if (block_size(node) >= required_size && (!best || block_size(node) < block_size(best)))
+          best = node;
+  return best;
+}
+#endif
 
-  // ! We need to ensure kMetadataSize + Minallocation size since 
+// ! Search the free lists (Best fit)
+void * searchBlock(Heap * heap, size_t size){
+  // ! 1. Find the best fit block
+  Block * best = NULL;
+
+  // ! We need to ensure kMinBlockSize since 
   //   we need the next and prev later when we free the block
 
   size_t user_request_size  = size + (kAllocMetadataSize << 1);
-  size_t minimum_alloc_size = kMinAllocationSize + kMetadataSize;
+  size_t minimum_alloc_size = kMinBlockSize;
   size_t required_size      = user_request_size > minimum_alloc_size ? user_request_size : minimum_alloc_size;
 
-  // ! Linear Time to find best fit
-  while (node){
-      if (block_size(node) >= required_size){
-          if (best){
-              if (block_size(best) > block_size(node)) 
-                  best = node;
-          }else best = node;
-      }
-      node = node->next;
+#ifdef SIMD_SCAN
+  // ! Vectorised scan of the size array
+  size_t slot = scanBestFit(heap->index_sizes, heap->index_count, (uint32_t) required_size);
+  if (slot < heap->index_count)
+      best = heap->index_blocks[slot];
+#else
+  // ! The request's own class may hold smaller blocks; every block of a
+  //   higher class fits
+  size_t cls = size_to_class(required_size);
+  best = bestInList(heap, heap->freeLists[cls], required_size);
+  if (!best){
+      cls = nextClass(heap, cls + 1);
+      if (cls < SIZE_CLASSES)
+          best = bestInList(heap, heap->freeLists[cls], required_size);
   }
+#endif
   // ! 1. Find Large Enough Blocks
   if (best){
     if (block_size(best) > required_size){
           // ! Leftover > Minimum Size (Split)
           size_t leftover = block_size(best) - required_size;
           if (leftover >= (minimum_alloc_size)){
-              removeNode(best);
+              removeNode(heap, best);
             
               // ! Leftover block (New Block: insert tags)
               Block * nBlock    = (Block *)((char *)best + required_size);
               nBlock->size      = leftover;
-              nBlock->next      = nBlock->prev = NULL;
+              nBlock->next      = nBlock->prev = 0;
               CLEAR_ALLOC_BIT(nBlock);
               insert_bound_tag(nBlock);
-              
-              if (freeList){
-                 nBlock->next   = freeList;
-                 freeList->prev = nBlock;
-              }
-              freeList = nBlock;
+              insertNode(heap, nBlock);
               
               // ! Allocated Block 
               best->size = required_size;
@@ -89,7 +319,7 @@ void * searchBlock(size_t size){
           }
           // ! LeftOver < Minimum Size (Allocate all)
           else{
-              removeNode(best);
+              removeNode(heap, best);
               SET_ALLOC_BIT(best);
               insert_bound_tag(best);
               return (void *)((char *)(best) + kAllocMetadataSize);
@@ -97,72 +327,108 @@ void * searchBlock(size_t size){
       }
       // ! Best Size == Required Size (Perfect)
       else{
-        removeNode(best);
+        removeNode(heap, best);
         SET_ALLOC_BIT(best);
         insert_bound_tag(best);
         return (void *)((char *)(best) + kAllocMetadataSize);
       }
     }
 
-  // ! 2. No match Blocks -> reallocation
-  if (required_size < (kMemorySize - kMetadataSize))
-      memoryAllocation(kMemorySize);
-  else if (required_size < (kMaxAllocationSize - kMetadataSize))
-      memoryAllocation(kMaxAllocationSize);
-  else 
+  // ! 2. No match Blocks -> wilderness, then a new arena (no rescan)
+  void * ptr = wildernessAllocation(heap, required_size);
+  if (ptr)
+      return ptr;
+  size_t arena_overhead = sizeof(Arena) + ((kArenaPadding + kFenceSize) << 1);
+  size_t alloc_size;
+  // ! 1. < 256MB
+  if (required_size + arena_overhead <= kMemorySize)
+      alloc_size = kMemorySize;
+  // ! 2. < 512 MB
+  else if (required_size + arena_overhead <= kMaxAllocationSize)
+      alloc_size = kMaxAllocationSize;
+  // ! 3. 1 GB
+  else alloc_size = (kMaxAllocationSize << 1);
+  if (!memoryAllocation(heap, alloc_size))
       return NULL;
-  return searchBlock(size);
+  return wildernessAllocation(heap, required_size);
 }
 
 // ! Internal function to mmap
-static void memoryAllocation(size_t size){
-      
+static int memoryAllocation(Heap * heap, size_t size){
+      if (heap->fixed)
+          return 0;
+#ifdef SMALL_HEAP
+      // ! Reserve the address space once, then make arenas readable and
+      //   writable one after the other
+      if (heap->base == NULL){
+          void * base = mmap(NULL, kHeapReserve, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
+          if (base == MAP_FAILED)
+              return 0;
+          heap->base = base;
+      }
+      // ! Sizes from kMaxAllocationSize are not page multiples: round up, so
+      //   that the next arena starts on a page and can be mprotected
+      size = memAlign(size, (size_t) sysconf(_SC_PAGESIZE));
+      if (size > kHeapReserve - heap->reserved)
+          return 0;
+      Arena * region         = (Arena *) (heap->base + heap->reserved);
+      if (mprotect(region, size, PROT_READ | PROT_WRITE))
+          return 0;
+      heap->reserved        += size;
+#else
       Arena * region         = (Arena *) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
-      Block * startfence     = (Block *) ((char *) region + sizeof(Arena));
-      Block * endfence       = (Block *) ((char *) region + size - kMetadataSize);
-      Block * freeregion     = (Block *) ((char *) startfence + kMetadataSize);
+      if (region == MAP_FAILED)
+          return 0;
+#endif
+      arenaInit(heap, region, size);
+      return 1;
+}
+
+// ! Lay out an arena over [region, region + size): header, fences and the
+//   wilderness
+static void arenaInit(Heap * heap, Arena * region, size_t size){
+      Block * startfence     = (Block *) ((char *) region + sizeof(Arena) + kArenaPadding);
+      Block * endfence       = (Block *) ((char *) region + size - kArenaPadding - kFenceSize);
+      Block * freeregion     = (Block *) ((char *) startfence + kFenceSize);
 
       // ! 1. mmap_arena 
       region->size         = size;
-      if (mmap_arena == NULL){
-          mmap_arena         = region;
-          mmap_arena->next   = NULL;
+      if (heap->mmap_arena == NULL){
+          heap->mmap_arena       = region;
+          heap->mmap_arena->next = NULL;
       }else{
-        region->next         = mmap_arena;
-        mmap_arena           = region;
+        region->next         = heap->mmap_arena;
+        heap->mmap_arena     = region;
       }
-      // ! 2. Start fence
-      startfence->prev       = NULL;
-      startfence->next       = NULL;
-      startfence->size       = kMetadataSize;
+      // ! 2. Start fence: tags only, a SMALL_HEAP fence is shorter than a Block
+      startfence->size       = kFenceSize;
       SET_ALLOC_BIT(startfence);
       insert_bound_tag(startfence);
 
 
       // ! 3. End fence
-      endfence->prev         = NULL;
-      endfence->next         = NULL;
-      endfence->size         = kMetadataSize;
+      endfence->size         = kFenceSize;
       SET_ALLOC_BIT(endfence);
       insert_bound_tag(endfence);
 
 
-      // 4. Free region
-      freeregion->size       = size - (kMetadataSize << 1) - sizeof(Arena);
-      freeregion->prev       = NULL;
-      freeregion->next       = NULL;
-      CLEAR_ALLOC_BIT(freeregion);
-      insert_bound_tag(freeregion);
-
-      if (freeList != NULL){
-          freeregion->next = freeList;
-          freeList->prev   = freeregion;
+      // 4. The rest of the old wilderness becomes an ordinary free block
+      //    (its left neighbour is allocated: frees next to it merge into it)
+      if (heap->wilderness != heap->wilderness_end){
+          Block * rest = (Block *) heap->wilderness;
+          CLEAR_ALLOC_BIT(rest);
+          insert_bound_tag(rest);
+          insertNode(heap, rest);
       }
-      freeList             = freeregion; 
+
+      // 5. Free region is the new wilderness
+      heap->wilderness             = (char *) freeregion;
+      heap->wilderness_end         = (char *) endfence;
+      wildernessTag(heap);
 }
 
 
-void *my_malloc(size_t size) {
+static void *malloc_locked(Heap * heap, size_t size) {
   if (size == 0)
       return NULL;
 
@@ -172,26 +438,25 @@ void *my_malloc(size_t size) {
 
   if (target_size > kMaxAllocationSize)
       return NULL;
-  if (!freeList){
-      size_t alloc_size = 0;
-      // ! 1. < 256MB
-      if (target_size < (kMemorySize - kMetadataSize))
-          alloc_size = kMemorySize;
-      // ! 2. < 512 MB
-      else if (target_size < (kMaxAllocationSize - kMetadataSize))
-          alloc_size = kMaxAllocationSize;
-      // ! 3. 1 GB
-      else alloc_size = (kMaxAllocationSize << 1);
-      memoryAllocation(alloc_size);
-  }
-  return searchBlock(target_size);
+  return searchBlock(heap, target_size);
+}
+
+void *my_heap_malloc(Heap *heap, size_t size) {
+  LOCK_HEAP(&heap->lock);
+  void *ptr = malloc_locked(heap, size);
+  UNLOCK_HEAP(&heap->lock);
+  return ptr;
+}
+
+void *my_malloc(size_t size) {
+  return my_heap_malloc(&default_heap, size);
 }
 
 // ! O(1) coalesce
-void coalesce(Block * node){
+void coalesce(Heap * heap, Block * node){
     if (block_size(node) <= kMetadataSize)
         return;
-    Arena * arena = mmap_arena;
+    Arena * arena = heap->mmap_arena;
     if (arena == NULL){
         printf("[Error]: Arena is NULL. This should not happen.\n");
     }
@@ -213,20 +478,16 @@ void coalesce(Block * node){
         return;
     }
     
-    Block * n = Left_Coalesce(node);
+    Block * n = Left_Coalesce(heap, node);
     if (n == NULL){
-        if (freeList){
-            node->next = freeList;
-            freeList->prev = node;
-        }
-        freeList = node;
-        Right_Coalesce(node);
+        insertNode(heap, node);
+        Right_Coalesce(heap, node);
     }
-    else Right_Coalesce(n);
+    else Right_Coalesce(heap, n);
     return;
 }
 
-Block * Left_Coalesce(Block * node){
+Block * Left_Coalesce(Heap * heap, Block * node){
     if (block_size(node) <= kMetadataSize)
         return NULL;
     if (!is_free(node)){
@@ -243,21 +504,17 @@ Block * Left_Coalesce(Block * node){
     if (!is_free(L_Blk))
         return NULL;
 
-    removeNode(node);
-    removeNode(L_Blk);
-    node->next         = node->prev = NULL;
-    L_Blk->next        = L_Blk->prev = NULL;
+    removeNode(heap, node);
+    removeNode(heap, L_Blk);
+    node->next         = node->prev = 0;
+    L_Blk->next        = L_Blk->prev = 0;
     L_Blk->size        += node->size;
     insert_bound_tag(L_Blk);
-    if (freeList){
-        L_Blk->next    = freeList;
-        freeList->prev = L_Blk;
-    }
-    freeList           = L_Blk;
+    insertNode(heap, L_Blk);
     return L_Blk;
 }
 
-Block * Right_Coalesce(Block * node){
+Block * Right_Coalesce(Heap * heap, Block * node){
     if (node->size <= kMetadataSize)
         return node;
     if (!is_free(node)){
@@ -265,31 +522,34 @@ Block * Right_Coalesce(Block * node){
         return node;
     }
     Block* R_Blk = (Block *) ((char *)node + node->size);
+    // ! Give the block back to the wilderness
+    if ((char *) R_Blk == heap->wilderness){
+        removeNode(heap, node);
+        heap->wilderness = (char *) node;
+        wildernessTag(heap);
+        return NULL;
+    }
     if (block_size(R_Blk) <= kMetadataSize)
         return node;
 
     if (is_free(R_Blk)){
-        removeNode(R_Blk);
-        removeNode(node);
-        node->next  = node->prev  = NULL;
-        R_Blk->next = R_Blk->prev = NULL;
+        removeNode(heap, R_Blk);
+        removeNode(heap, node);
+        node->next  = node->prev  = 0;
+        R_Blk->next = R_Blk->prev = 0;
         node->size  += R_Blk->size;
         insert_bound_tag(node);
-        if (freeList){
-            node->next = freeList;
-            freeList->prev = node;
-        }
-        freeList = node;
+        insertNode(heap, node);
     }
     return node;
 }
 
-void my_free(void *ptr) {
+static void free_locked(Heap * heap, void *ptr) {
     if (!ptr) 
         return;
     if (((size_t) ptr) & (kAlignment -1))
         return;
-    if (mmap_arena == NULL)
+    if (heap->mmap_arena == NULL)
         return;
 
     Block * m_data = (Block *)((char *) ptr - kAllocMetadataSize);
@@ -298,15 +558,552 @@ void my_free(void *ptr) {
 
     if (block_size(m_data) <= kMetadataSize)
         return;
-    m_data->next = m_data->prev = NULL;
+    m_data->next = m_data->prev = 0;
     CLEAR_ALLOC_BIT(m_data);
     insert_bound_tag(m_data);
     // ! 3. Linear Coelasce
-    coalesce(m_data);
+    coalesce(heap, m_data);
  
     return;
 }
 
+void my_heap_free(Heap *heap, void *ptr) {
+    LOCK_HEAP(&heap->lock);
+    free_locked(heap, ptr);
+    UNLOCK_HEAP(&heap->lock);
+}
+
+void my_free(void *ptr) {
+    my_heap_free(&default_heap, ptr);
+}
+
+// ! mmap rather than my_malloc: a destroyed heap leaves nothing behind in
+//   the default one
+Heap *my_heap_create(void) {
+    Heap * heap = mmap(NULL, sizeof(Heap), PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (heap == MAP_FAILED)
+        return NULL;
+    // ! Zeroed by mmap: no arena, empty lists
+#ifdef THREADSAFE
+    pthread_mutex_init(&heap->lock, NULL);
+#endif
+    return heap;
+}
+
+// ! The heap and its one arena sit in the buffer, aligned to a word
+Heap *my_heap_init_static(void *buf, size_t len) {
+    size_t start     = memAlign((size_t) buf, kAlignment);
+    size_t heap_size = memAlign(sizeof(Heap), kAlignment);
+    size_t overhead  = (start - (size_t) buf) + heap_size + sizeof(Arena) + ((kArenaPadding + kFenceSize) << 1);
+    if (!buf || len < overhead + kMinBlockSize)
+        return NULL;
+    // ! No bigger than the largest mapped arena: block sizes stay in range
+    //   of the size classes and the 32-bit index
+    if (len > (kMaxAllocationSize << 1))
+        len = kMaxAllocationSize << 1;
+    Heap * heap = (Heap *) start;
+    memset(heap, 0, sizeof(Heap));
+    heap->fixed = 1;
+#ifdef THREADSAFE
+    pthread_mutex_init(&heap->lock, NULL);
+#endif
+    size_t arena_size = (len - (start - (size_t) buf) - heap_size) & ~(kAlignment - 1);
+#ifdef SMALL_HEAP
+    heap->base     = (char *) (start + heap_size);
+    heap->reserved = arena_size;
+#endif
+    arenaInit(heap, (Arena *) (start + heap_size), arena_size);
+    return heap;
+}
+
+void my_heap_destroy(Heap *heap) {
+    if (!heap || heap == &default_heap)
+        return;
+#ifdef SIMD_SCAN
+    if (heap->index_cap){
+        munmap(heap->index_sizes, heap->index_cap * sizeof(uint32_t));
+        munmap(heap->index_blocks, heap->index_cap * sizeof(Block *));
+    }
+#endif
+#ifdef THREADSAFE
+    pthread_mutex_destroy(&heap->lock);
+#endif
+    // ! The buffer of a static heap belongs to the caller
+    if (heap->fixed)
+        return;
+#ifdef SMALL_HEAP
+    // ! Every arena is in the reservation
+    if (heap->base)
+        munmap(heap->base, kHeapReserve);
+#else
+    Arena * next;
+    for (Arena * arena = heap->mmap_arena; arena; arena = next){
+        next = arena->next;
+        munmap(arena, arena->size);
+    }
+#endif
+    munmap(heap, sizeof(Heap));
+}
+
+// ! The block can be larger than the request (leftovers too small to split,
+//   aligned allocations), so its size still comes from the header
+void my_free_sized(void *ptr, size_t size) {
+    (void) size;
+    my_free(ptr);
+}
+
+// ! Free [block, block + size) cut off an allocated block
+static void releaseSplit(Heap * heap, Block * block, size_t size){
+    block->size = size;
+    block->next = block->prev = 0;
+    CLEAR_ALLOC_BIT(block);
+    insert_bound_tag(block);
+    coalesce(heap, block);
+}
+
+// ! Over-allocate, then give back the part before the aligned address and
+//   the part after the request
+static void *aligned_alloc_locked(Heap * heap, size_t alignment, size_t size){
+    size_t minimum_block = kMinBlockSize;
+    char * ptr = malloc_locked(heap, size + alignment + minimum_block);
+    if (!ptr)
+        return NULL;
+    char * aligned = (char *) memAlign((size_t) ptr, alignment);
+    // ! The leading part must be empty or a block on its own: it ends up
+    //   shorter than minimum_block + alignment
+    while (aligned != ptr && (size_t) (aligned - ptr) < minimum_block)
+        aligned += alignment;
+
+    Block * block = ptr_to_block(ptr);
+    size_t total  = block_size(block);
+    if (aligned != ptr){
+        size_t lead = aligned - ptr;
+        Block * aBlock = ptr_to_block(aligned);
+        aBlock->size   = total - lead;
+        SET_ALLOC_BIT(aBlock);
+        insert_bound_tag(aBlock);
+        releaseSplit(heap, block, lead);
+        block = aBlock;
+        total -= lead;
+    }
+
+    size_t required_size = memAlign(size, kAlignment) + (kAllocMetadataSize << 1);
+    if (required_size < minimum_block)
+        required_size = minimum_block;
+    if (total - required_size >= minimum_block){
+        block->size = required_size;
+        SET_ALLOC_BIT(block);
+        insert_bound_tag(block);
+        releaseSplit(heap, (Block *)((char *) block + required_size), total - required_size);
+    }
+    return aligned;
+}
+
+void *my_heap_aligned_alloc(Heap *heap, size_t alignment, size_t size) {
+    if (alignment & (alignment - 1))
+        return NULL;
+    if (alignment <= kAlignment)
+        return my_heap_malloc(heap, size);
+    if (size == 0 || size > kMaxAllocationSize - alignment)
+        return NULL;
+    LOCK_HEAP(&heap->lock);
+    void *ptr = aligned_alloc_locked(heap, alignment, size);
+    UNLOCK_HEAP(&heap->lock);
+    return ptr;
+}
+
+void *my_aligned_alloc(size_t alignment, size_t size) {
+    return my_heap_aligned_alloc(&default_heap, alignment, size);
+}
+
+
+// ! Regions: chunks from the heap, bump allocated, reset in O(1)
+typedef struct RegionChunk {
+    struct RegionChunk * next;
+    // Usable bytes after this header
+    size_t size;
+} RegionChunk;
+
+struct Region {
+    // Every chunk, in the order they are used; current is the one being
+    // bumped, NULL until the first allocation after a reset
+    RegionChunk * first;
+    RegionChunk * current;
+    char * ptr;
+    char * end;
+    size_t chunk_size;
+};
+
+#ifdef REGION_GUARD
+// ! An allocated, zero-size header before each allocation: my_free ignores it
+//   like a fence. A word, so that allocations stay aligned with a 4-byte tag
+static const size_t kRegionTagSize = kAlignment;
+#else
+static const size_t kRegionTagSize = 0;
+#endif
+
+Region *my_region_create(size_t chunk_size) {
+    if (chunk_size == 0)
+        chunk_size = kRegionChunkSize;
+    if (chunk_size > kMaxAllocationSize)
+        return NULL;
+    Region * region = my_malloc(sizeof(Region));
+    if (!region)
+        return NULL;
+    region->first      = region->current = NULL;
+    region->ptr        = region->end = NULL;
+    region->chunk_size = memAlign(chunk_size, kAlignment);
+    return region;
+}
+
+// ! Move to the chunk after the current one, or put a new one there when it
+//   is missing or too small for need bytes
+static int regionNextChunk(Region * region, size_t need){
+    RegionChunk ** link = region->current ? &region->current->next : &region->first;
+    RegionChunk * chunk = *link;
+    if (!chunk || chunk->size < need){
+        size_t size = need > region->chunk_size ? need : region->chunk_size;
+        chunk = my_malloc(sizeof(RegionChunk) + size);
+        if (!chunk)
+            return 0;
+        chunk->size = size;
+        chunk->next = *link;
+        *link = chunk;
+    }
+    region->current = chunk;
+    region->ptr     = (char *) (chunk + 1);
+    region->end     = region->ptr + chunk->size;
+    return 1;
+}
+
+void *my_region_alloc(Region *region, size_t size) {
+    return my_region_aligned_alloc(region, kAlignment, size);
+}
+
+// ! Chunks start word aligned: the padding is below alignment - kAlignment
+void *my_region_aligned_alloc(Region *region, size_t alignment, size_t size) {
+    if (alignment & (alignment - 1))
+        return NULL;
+    if (alignment < kAlignment)
+        alignment = kAlignment;
+    if (!region || size == 0 || size > kMaxAllocationSize - alignment)
+        return NULL;
+    size_t need = memAlign(size, kAlignment);
+    size_t ptr  = memAlign((size_t) region->ptr + kRegionTagSize, alignment);
+    if (!region->ptr || ptr + need > (size_t) region->end){
+        if (!regionNextChunk(region, need + kRegionTagSize + alignment - kAlignment))
+            return NULL;
+        ptr = memAlign((size_t) region->ptr + kRegionTagSize, alignment);
+    }
+    region->ptr = (char *) ptr + need;
+#ifdef REGION_GUARD
+    *(Tag_t *) (ptr - sizeof(Tag_t)) = 1;
+#endif
+    return (void *) ptr;
+}
+
+void my_region_reset(Region *region) {
+    if (!region)
+        return;
+    // ! The chunks are kept and bumped through again
+    region->current = NULL;
+    region->ptr     = region->end = NULL;
+}
+
+void my_region_destroy(Region *region) {
+    if (!region)
+        return;
+    RegionChunk * next;
+    for (RegionChunk * chunk = region->first; chunk; chunk = next){
+        next = chunk->next;
+        my_free(chunk);
+    }
+    my_free(region);
+}
+
+// ! Pools: objects of one size carved from chunks taken from the heap, free
+//   objects linked through their first word
+typedef struct PoolObject {
+    struct PoolObject * next;
+} PoolObject;
+
+typedef struct PoolChunk {
+    struct PoolChunk * next;
+    size_t size;
+} PoolChunk;
+
+struct Pool {
+    PoolObject * free;
+    PoolChunk  * chunks;
+    // Part of the newest chunk not carved into objects yet
+    char * ptr;
+    char * end;
+    size_t stride;
+    size_t align;
+    // Objects handed out (to callers or per-thread caches) / on free
+    size_t objects;
+    size_t free_objects;
+    size_t chunk_bytes;
+    // Registry of live pools, for the heap stats and the per-thread caches
+    size_t id;
+    struct Pool * next;
+    struct Pool * prev;
+#ifdef THREADSAFE
+    pthread_mutex_t lock;
+#endif
+};
+
+static Pool * pools   = NULL;
+static size_t pool_id = 0;
+#ifdef THREADSAFE
+// Held around the registry; taken before a pool's lock
+static pthread_mutex_t pools_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+Pool *my_pool_create(size_t obj_size, size_t align) {
+    if (align < kAlignment)
+        align = kAlignment;
+    if ((align & (align - 1)) || obj_size == 0 || obj_size > kPoolChunkSize)
+        return NULL;
+    Pool * pool = my_malloc(sizeof(Pool));
+    if (!pool)
+        return NULL;
+    size_t size  = obj_size > sizeof(PoolObject) ? obj_size : sizeof(PoolObject);
+    pool->stride = memAlign(size, align);
+    pool->align  = align;
+    pool->free   = NULL;
+    pool->chunks = NULL;
+    pool->ptr    = pool->end = NULL;
+    pool->objects = pool->free_objects = pool->chunk_bytes = 0;
+#ifdef THREADSAFE
+    pthread_mutex_init(&pool->lock, NULL);
+#endif
+    LOCK_HEAP(&pools_lock);
+    pool->id   = ++pool_id;
+    pool->prev = NULL;
+    pool->next = pools;
+    if (pools) pools->prev = pool;
+    pools = pool;
+    UNLOCK_HEAP(&pools_lock);
+    return pool;
+}
+
+// ! Pool lock held
+static void *poolAllocLocked(Pool * pool){
+    if (pool->free){
+        PoolObject * object = pool->free;
+        pool->free = object->next;
+        pool->free_objects--;
+        pool->objects++;
+        return object;
+    }
+    // ! ptr is NULL until the first chunk, and never past end after it
+    if (!pool->ptr || (size_t) (pool->end - pool->ptr) < pool->stride){
+        // ! Room for the header, the alignment padding and the objects
+        size_t size = sizeof(PoolChunk) + pool->align + pool->stride * (kPoolChunkSize / pool->stride);
+        PoolChunk * chunk = my_malloc(size);
+        if (!chunk)
+            return NULL;
+        chunk->size   = size;
+        chunk->next   = pool->chunks;
+        pool->chunks  = chunk;
+        pool->chunk_bytes += size;
+        pool->ptr = (char *) memAlign((size_t) (chunk + 1), pool->align);
+        pool->end = (char *) chunk + size;
+    }
+    void * object = pool->ptr;
+    pool->ptr += pool->stride;
+    pool->objects++;
+    return object;
+}
+
+// ! Pool lock held; list is count objects ending at tail
+static void poolFreeLocked(Pool * pool, PoolObject * list, PoolObject * tail, size_t count){
+    tail->next = pool->free;
+    pool->free = list;
+    pool->free_objects += count;
+    pool->objects      -= count;
+}
+
+#if defined(THREADSAFE) && defined(POOL_CACHE)
+// ! Per-thread front cache (POOL_CACHE=1): each thread keeps a few objects of
+//   a few pools, moved from and to the pool in batches so that most calls do
+//   not take the pool's lock. Slots are keyed by pool id, never reused, so a
+//   slot of a destroyed pool is recognised and dropped.
+#define kPoolCacheSlots 8
+#define kPoolCacheBatch 32
+
+typedef struct PoolCache {
+    size_t id;
+    PoolObject * objects;
+    size_t count;
+} PoolCache;
+
+static __thread PoolCache pool_cache[kPoolCacheSlots];
+static pthread_key_t  pool_cache_key;
+static pthread_once_t pool_cache_once = PTHREAD_ONCE_INIT;
+
+// ! Give back the count objects of a slot to their pool, if it still exists.
+//   The pool is looked up first: the objects of a destroyed one sit in chunks
+//   already back in the heap, the list is dropped without reading them.
+static void poolCacheFlush(PoolCache * cache, size_t count){
+    if (count == 0)
+        return;
+    LOCK_HEAP(&pools_lock);
+    Pool * pool = pools;
+    while (pool && pool->id != cache->id)
+        pool = pool->next;
+    if (!pool){
+        cache->objects = NULL;
+        cache->count   = 0;
+        UNLOCK_HEAP(&pools_lock);
+        return;
+    }
+    // ! pools_lock keeps the pool, and so its chunks, alive during the walk
+    PoolObject * list = cache->objects, * tail = list;
+    for (size_t i = 1; i < count; i++)
+        tail = tail->next;
+    cache->objects = tail->next;
+    cache->count  -= count;
+    LOCK_HEAP(&pool->lock);
+    poolFreeLocked(pool, list, tail, count);
+    UNLOCK_HEAP(&pool->lock);
+    UNLOCK_HEAP(&pools_lock);
+}
+
+static void poolCacheExit(void * cache){
+    (void) cache;
+    for (size_t i = 0; i < kPoolCacheSlots; i++)
+        poolCacheFlush(&pool_cache[i], pool_cache[i].count);
+}
+
+static void poolCacheKey(void){
+    pthread_key_create(&pool_cache_key, poolCacheExit);
+}
+
+static PoolCache * poolCache(Pool * pool){
+    PoolCache * cache = &pool_cache[pool->id % kPoolCacheSlots];
+    if (cache->id != pool->id){
+        if (cache->id == 0){
+            // ! First use in this thread: flush the slots when it exits
+            pthread_once(&pool_cache_once, poolCacheKey);
+            pthread_setspecific(pool_cache_key, pool_cache);
+        }
+        poolCacheFlush(cache, cache->count);
+        cache->id = pool->id;
+    }
+    return cache;
+}
+#endif
+
+void *my_pool_alloc(Pool *pool) {
+    if (!pool)
+        return NULL;
+#if defined(THREADSAFE) && defined(POOL_CACHE)
+    PoolCache * cache = poolCache(pool);
+    if (!cache->objects){
+        LOCK_HEAP(&pool->lock);
+        for (size_t i = 0; i < kPoolCacheBatch; i++){
+            PoolObject * object = poolAllocLocked(pool);
+            if (!object)
+                break;
+            object->next   = cache->objects;
+            cache->objects = object;
+            cache->count++;
+        }
+        UNLOCK_HEAP(&pool->lock);
+        if (!cache->objects)
+            return NULL;
+    }
+    PoolObject * object = cache->objects;
+    cache->objects = object->next;
+    cache->count--;
+    return object;
+#else
+    LOCK_HEAP(&pool->lock);
+    void * object = poolAllocLocked(pool);
+    UNLOCK_HEAP(&pool->lock);
+    return object;
+#endif
+}
+
+void my_pool_free(Pool *pool, void *ptr) {
+    if (!pool || !ptr)
+        return;
+    PoolObject * object = ptr;
+#if defined(THREADSAFE) && defined(POOL_CACHE)
+    PoolCache * cache = poolCache(pool);
+    object->next   = cache->objects;
+    cache->objects = object;
+    if (++cache->count > 2 * kPoolCacheBatch)
+        poolCacheFlush(cache, kPoolCacheBatch);
+#else
+    LOCK_HEAP(&pool->lock);
+    poolFreeLocked(pool, object, object, 1);
+    UNLOCK_HEAP(&pool->lock);
+#endif
+}
+
+void my_pool_destroy(Pool *pool) {
+    if (!pool)
+        return;
+    LOCK_HEAP(&pools_lock);
+    if (pool->prev) pool->prev->next = pool->next;
+    if (pool->next) pool->next->prev = pool->prev;
+    if (pool == pools) pools = pool->next;
+    UNLOCK_HEAP(&pools_lock);
+#if defined(THREADSAFE) && defined(POOL_CACHE)
+    // ! This thread's slot; other threads drop theirs when they next use it
+    PoolCache * cache = &pool_cache[pool->id % kPoolCacheSlots];
+    if (cache->id == pool->id){
+        cache->objects = NULL;
+        cache->count   = 0;
+    }
+#endif
+    PoolChunk * next;
+    for (PoolChunk * chunk = pool->chunks; chunk; chunk = next){
+        next = chunk->next;
+        my_free(chunk);
+    }
+#ifdef THREADSAFE
+    pthread_mutex_destroy(&pool->lock);
+#endif
+    my_free(pool);
+}
+
+void my_heap_get_stats(HeapStats *stats) {
+    Heap * heap = &default_heap;
+    memset(stats, 0, sizeof(*stats));
+    LOCK_HEAP(&heap->lock);
+    for (Arena * arena = heap->mmap_arena; arena; arena = arena->next){
+        stats->arenas++;
+        stats->heap_bytes += arena->size;
+    }
+    for (Block * block = get_start_block(); block; block = get_next_block(block)){
+        if ((char *) block == heap->wilderness)
+            stats->wilderness_bytes += block_size(block);
+        else if (is_free(block)){
+            stats->free_blocks++;
+            stats->free_bytes += block_size(block);
+        }
+        else{
+            stats->allocated_blocks++;
+            stats->allocated_bytes += block_size(block);
+        }
+    }
+    UNLOCK_HEAP(&heap->lock);
+
+    LOCK_HEAP(&pools_lock);
+    for (Pool * pool = pools; pool; pool = pool->next){
+        LOCK_HEAP(&pool->lock);
+        stats->pools++;
+        stats->pool_bytes        += pool->chunk_bytes;
+        stats->pool_objects      += pool->objects;
+        stats->pool_free_objects += pool->free_objects;
+        UNLOCK_HEAP(&pool->lock);
+    }
+    UNLOCK_HEAP(&pools_lock);
+}
 
 /** These are helper functions you are required to implement for internal testing
  *  purposes. Depending on the optimisations you implement, you will need to
@@ -323,10 +1120,16 @@ size_t block_size(Block *block) {
   return GET_SIZE(block);
 }
 
+// ! First block of an arena, after its start fence
+static Block *arenaFirstBlock(Arena *arena) {
+    return (Block *)((char *) arena + sizeof(Arena) + kArenaPadding + kFenceSize);
+}
+
 /* Returns the first block in memory (excluding fenceposts) */
 Block *get_start_block(void) {
-    if (!mmap_arena) return NULL;
-    return (Block *)((char *)mmap_arena + sizeof(Arena) + kMetadataSize);
+    Heap * heap = &default_heap;
+    if (!heap->mmap_arena) return NULL;
+    return arenaFirstBlock(heap->mmap_arena);
 }
 
 /* Returns the next block in memory */
@@ -336,7 +1139,7 @@ Block *get_next_block(Block *block) {
     Block * next_block = (Block *) ((char *) block + block_size(block));
     
     if (GET_SIZE(next_block) <= kMetadataSize){
-        Arena * arena = mmap_arena;
+        Arena * arena = default_heap.mmap_arena;
         while (arena){
             size_t a_start = (size_t)arena;
             size_t a_end   = a_start + arena->size;
@@ -344,7 +1147,7 @@ Block *get_next_block(Block *block) {
             if (block_addr >= a_start && block_addr < a_end){
                 Arena * next_arena = arena->next;
                 if (next_arena) 
-                    return (Block *) ((char *) next_arena + sizeof(Arena) + kMetadataSize);
+                    return arenaFirstBlock(next_arena);
                 return NULL;
             }
             arena = arena->next;
@@ -359,17 +1162,55 @@ Block *ptr_to_block(void *ptr) {
   return ADD_BYTES(ptr, -((ssize_t) kAllocMetadataSize));
 }
 
-static void removeNode(Block* b) {
+#ifdef SIMD_SCAN
+// ! Swap with the last slot
+static void removeNode(Heap * heap, Block* b) {
+    if (!b || !b->next) return;
+    size_t slot = (size_t) b->next - 1;
+    Block * last = heap->index_blocks[--heap->index_count];
+    heap->index_sizes[slot]  = heap->index_sizes[heap->index_count];
+    heap->index_blocks[slot] = last;
+    last->next = (BlockRef) (slot + 1);
+    b->next = b->prev = 0;
+}
+
+static void insertNode(Heap * heap, Block* b) {
+    if (heap->index_count == heap->index_cap && !indexGrow(heap)){
+        // ! Out of memory for the index: the block is leaked
+        b->next = b->prev = 0;
+        return;
+    }
+    heap->index_sizes[heap->index_count]  = (uint32_t) block_size(b);
+    heap->index_blocks[heap->index_count] = b;
+    b->next = (BlockRef) (heap->index_count + 1);
+    b->prev = 0;
+    heap->index_count++;
+}
+#else
+static void removeNode(Heap * heap, Block* b) {
     if (!b) return;
 
-    if (b->prev) b->prev->next = b->next;
-    if (b->next) b->next->prev = b->prev;
-    if (b == freeList) {
-        freeList = b->next;
-        if (freeList) freeList->prev = NULL;
+    if (b->prev) REF_BLOCK(heap, b->prev)->next = b->next;
+    if (b->next) REF_BLOCK(heap, b->next)->prev = b->prev;
+    size_t cls = size_to_class(block_size(b));
+    if (b == heap->freeLists[cls]) {
+        heap->freeLists[cls] = REF_BLOCK(heap, b->next);
+        if (heap->freeLists[cls]) heap->freeLists[cls]->prev = 0;
+        else heap->freeListBits[cls / 64] &= ~(1ull << (cls % 64));
     }
-    b->next = b->prev = NULL;
+    b->next = b->prev = 0;
+}
+
+// ! Push onto the head of its class's free list
+static void insertNode(Heap * heap, Block* b) {
+    size_t cls = size_to_class(block_size(b));
+    b->prev = 0;
+    b->next = BLOCK_REF(heap, heap->freeLists[cls]);
+    if (heap->freeLists[cls]) heap->freeLists[cls]->prev = BLOCK_REF(heap, b);
+    heap->freeLists[cls] = b;
+    heap->freeListBits[cls / 64] |= 1ull << (cls % 64);
 }
+#endif
 
 static void insert_bound_tag(Block * node){
     size_t size    = block_size(node);
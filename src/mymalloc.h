@@ -4,14 +4,29 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <sys/mman.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #ifdef ENABLE_LOG
 #define LOG(...) fprintf(stderr, "[malloc] " __VA_ARGS__);
 #else
 #define LOG(...)
 #endif
 
+// One lock around the whole heap, for multi-threaded programs (THREADSAFE=1)
+#ifdef THREADSAFE
+#include <pthread.h>
+#define LOCK_HEAP(lock) pthread_mutex_lock(lock)
+#define UNLOCK_HEAP(lock) pthread_mutex_unlock(lock)
+#else
+#define LOCK_HEAP(lock)
+#define UNLOCK_HEAP(lock)
+#endif
+
 #define N_LISTS 25
 
 #define ADD_BYTES(ptr, n) ((void *) (((char *) (ptr)) + (n)))
@@ -24,15 +39,25 @@
  *  explicit free list. You are allowed to modify this struct (and will need to 
  *  for certain optimisations) as long as you don't move the definition from 
  *  this file. **/
-typedef size_t Tag_t;
-
 typedef struct Block Block;
 
+/* With SMALL_HEAP=1 (mymalloc) each heap lives in one 4 GB reservation, so
+   tags and free-list links fit in 32 bits: a link is the offset of the block
+   from the heap's base, 0 for none. A free block's metadata shrinks from 24
+   to 12 bytes and the smallest block from 32 to 16. */
+#ifdef SMALL_HEAP
+typedef uint32_t Tag_t;
+typedef uint32_t BlockRef;
+#else
+typedef size_t Tag_t;
+typedef Block *BlockRef;
+#endif
+
 struct Block {
   // Size of the block, including meta-data size.
   Tag_t size;
-  Block *next;
-  Block *prev;
+  BlockRef next;
+  BlockRef prev;
 };
 
 typedef struct Arena{
@@ -50,9 +75,88 @@ extern const size_t kMetadataSize;
 extern const size_t kMaxAllocationSize;
 // Memory size that is mmapped (256 MB)
 extern const size_t kMemorySize;
+// Default chunk size of a region (64 KB)
+extern const size_t kRegionChunkSize;
+// Chunk size of a pool, and largest pool object (64 KB)
+extern const size_t kPoolChunkSize;
 
 void *my_malloc(size_t size);
 void my_free(void *p);
+// A plain alias of my_free, kept so sized deallocation has an entry point:
+// size is ignored, and the block header is read as for my_free (blocks can
+// be larger than requested, so size does not give the block size)
+void my_free_sized(void *p, size_t size);
+// alignment is a power of two; freed with my_free
+void *my_aligned_alloc(size_t alignment, size_t size);
+
+/* Independent heaps, each with its own arenas, free lists and lock (with
+   THREADSAFE=1); my_malloc / my_free use a default heap. A block goes back to
+   the heap it came from. my_heap_destroy unmaps every arena of the heap at
+   once, whatever is still allocated in it. The internal-test helpers, the
+   stats, regions and pools work on the default heap. */
+typedef struct Heap Heap;
+
+Heap *my_heap_create(void);
+/* A heap over [buf, buf + len), handle included, of at most 1 GB: it never
+   maps memory and my_heap_malloc returns NULL once the buffer is full. NULL if len is too
+   small for the handle and one block. my_heap_destroy leaves the buffer to
+   the caller. With SIMD_SCAN=1 the free-block index is still mmapped. */
+Heap *my_heap_init_static(void *buf, size_t len);
+void *my_heap_malloc(Heap *heap, size_t size);
+// alignment is a power of two; freed with my_heap_free
+void *my_heap_aligned_alloc(Heap *heap, size_t alignment, size_t size);
+void my_heap_free(Heap *heap, void *ptr);
+void my_heap_destroy(Heap *heap);
+
+/* Regions bump-allocate from chunks taken from the heap and release all their
+   allocations at once: reset keeps the chunks for reuse, destroy returns them.
+   A region is used by one thread at a time. Region pointers must not be
+   passed to my_free, unless the allocator is built with REGION_GUARD=1, which
+   makes my_free ignore them at the cost of a word per allocation. */
+typedef struct Region Region;
+
+// chunk_size 0 picks kRegionChunkSize; larger allocations get their own chunk
+Region *my_region_create(size_t chunk_size);
+void *my_region_alloc(Region *region, size_t size);
+// alignment is a power of two
+void *my_region_aligned_alloc(Region *region, size_t alignment, size_t size);
+void my_region_reset(Region *region);
+void my_region_destroy(Region *region);
+
+/* Pools hand out objects of one size from chunks taken from the heap, with
+   no size lookup. Objects go back with my_pool_free to the pool they came
+   from; my_pool_destroy returns every chunk to the heap. With THREADSAFE=1
+   and POOL_CACHE=1 each thread keeps a small cache of objects per pool. */
+typedef struct Pool Pool;
+
+// align is a power of two, 0 for word alignment
+Pool *my_pool_create(size_t obj_size, size_t align);
+void *my_pool_alloc(Pool *pool);
+void my_pool_free(Pool *pool, void *ptr);
+void my_pool_destroy(Pool *pool);
+
+typedef struct HeapStats {
+  // Arenas / bytes mapped for arenas
+  size_t arenas;
+  size_t heap_bytes;
+  // Blocks / bytes allocated and free, metadata included. Region and pool
+  // chunks count as allocated blocks.
+  size_t allocated_blocks;
+  size_t allocated_bytes;
+  size_t free_blocks;
+  size_t free_bytes;
+  // Untouched tail of the newest arena
+  size_t wilderness_bytes;
+  // Live pools, bytes of their chunks, objects handed out (per-thread caches
+  // included) and objects on the pools' free lists
+  size_t pools;
+  size_t pool_bytes;
+  size_t pool_objects;
+  size_t pool_free_objects;
+} HeapStats;
+
+// Walks the heap: O(blocks)
+void my_heap_get_stats(HeapStats *stats);
 
 /* Helper functions you are required to implement for internal testing. */
 int is_free(Block *block);
@@ -62,4 +166,8 @@ Block *get_start_block(void);
 Block *get_next_block(Block *block);
 Block *ptr_to_block(void *ptr);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
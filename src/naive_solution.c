@@ -1,4 +1,4 @@
-#include "mymalloc.h"
+#include "naive_solution.h"
 
 // Word alignment
 const size_t kAlignment = sizeof(size_t);
@@ -282,14 +282,13 @@ static void removeNode(Block* b) {
 static void replaceNode(Block * o_node, Block* n_node){
   if (!o_node || !n_node) return;
 
-  if (o_node->prev) {
+  // ! n_node may be carved from stale memory: always overwrite its links
+  n_node->prev = o_node->prev;
+  n_node->next = o_node->next;
+  if (o_node->prev)
       o_node->prev->next = n_node;
-      n_node->prev       = o_node->prev;
-  }
-  if (o_node->next) {
+  if (o_node->next)
       o_node->next->prev = n_node;
-      n_node->next       = o_node->next;
-  } 
 
   if (o_node == freeList){
       freeList       = n_node;
@@ -0,0 +1,72 @@
+#ifndef SIZE_CLASSES_H
+#define SIZE_CLASSES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Size classes of the segregated free lists. Block sizes up to
+ *  SIZE_CLASS_LINEAR_MAX get one class per SIZE_CLASS_STEP bytes; above that
+ *  every power of two is split into 2^SIZE_CLASS_STEPS_LOG2 classes. Fewer,
+ *  wider classes mean fewer lists but a longer best-fit scan in each.
+ *
+ *  Sizes up to SIZE_CLASS_TABLE_MAX are mapped by one lookup in a table the
+ *  compiler builds from the same formula (SIZE_CLASS_OF), larger ones with a
+ *  clz. Override the defaults with make SIZE_CLASSES="-DSIZE_CLASS_...=". **/
+
+#ifndef SIZE_CLASS_STEP
+#define SIZE_CLASS_STEP 8
+#endif
+#ifndef SIZE_CLASS_LINEAR_MAX
+#define SIZE_CLASS_LINEAR_MAX 128
+#endif
+#ifndef SIZE_CLASS_STEPS_LOG2
+#define SIZE_CLASS_STEPS_LOG2 2
+#endif
+// Table granule: block sizes are multiples of 8
+#define SIZE_CLASS_GRANULE 8
+#define SIZE_CLASS_TABLE_MAX 1024
+// Largest block size handled (arenas are below 2 GB)
+#define SIZE_CLASS_MAX_LOG2 31
+
+#define SIZE_CLASS_LOG2(x) (63 - __builtin_clzll((unsigned long long) (x)))
+#define SIZE_CLASS_LINEAR_CLASSES (SIZE_CLASS_LINEAR_MAX / SIZE_CLASS_STEP)
+#define SIZE_CLASS_LINEAR_LOG2 SIZE_CLASS_LOG2(SIZE_CLASS_LINEAR_MAX)
+#define SIZE_CLASS_STEPS (1 << SIZE_CLASS_STEPS_LOG2)
+#define SIZE_CLASSES \
+  (SIZE_CLASS_LINEAR_CLASSES + (SIZE_CLASS_MAX_LOG2 - SIZE_CLASS_LINEAR_LOG2) * SIZE_CLASS_STEPS)
+
+_Static_assert((SIZE_CLASS_LINEAR_MAX & (SIZE_CLASS_LINEAR_MAX - 1)) == 0,
+               "SIZE_CLASS_LINEAR_MAX must be a power of two");
+_Static_assert(SIZE_CLASS_LINEAR_MAX % SIZE_CLASS_STEP == 0 && SIZE_CLASS_STEP % SIZE_CLASS_GRANULE == 0,
+               "SIZE_CLASS_STEP must divide SIZE_CLASS_LINEAR_MAX and be a multiple of 8");
+_Static_assert(SIZE_CLASS_LINEAR_MAX <= SIZE_CLASS_TABLE_MAX && SIZE_CLASSES <= 256,
+               "size classes do not fit the lookup table");
+_Static_assert((1 << SIZE_CLASS_STEPS_LOG2) <= SIZE_CLASS_LINEAR_MAX / 2,
+               "too many steps per power of two");
+
+// Class of a block of s bytes (s > 0), a constant expression for constant s
+#define SIZE_CLASS_SHIFT(s) \
+  (SIZE_CLASS_LOG2((s) - 1) > SIZE_CLASS_STEPS_LOG2 ? SIZE_CLASS_LOG2((s) - 1) - SIZE_CLASS_STEPS_LOG2 : 0)
+#define SIZE_CLASS_OF(s)                                                        \
+  ((s) <= SIZE_CLASS_LINEAR_MAX                                                 \
+       ? ((s) + SIZE_CLASS_STEP - 1) / SIZE_CLASS_STEP - 1                      \
+       : SIZE_CLASS_LINEAR_CLASSES +                                            \
+             (SIZE_CLASS_LOG2((s) - 1) - SIZE_CLASS_LINEAR_LOG2) * SIZE_CLASS_STEPS + \
+             ((((s) - 1) >> SIZE_CLASS_SHIFT(s)) & (SIZE_CLASS_STEPS - 1)))
+
+#define SIZE_CLASS_E(i) SIZE_CLASS_OF(((i) + 1) * SIZE_CLASS_GRANULE)
+#define SIZE_CLASS_E4(i) SIZE_CLASS_E(i), SIZE_CLASS_E(i + 1), SIZE_CLASS_E(i + 2), SIZE_CLASS_E(i + 3)
+#define SIZE_CLASS_E16(i) SIZE_CLASS_E4(i), SIZE_CLASS_E4(i + 4), SIZE_CLASS_E4(i + 8), SIZE_CLASS_E4(i + 12)
+#define SIZE_CLASS_E64(i) SIZE_CLASS_E16(i), SIZE_CLASS_E16(i + 16), SIZE_CLASS_E16(i + 32), SIZE_CLASS_E16(i + 48)
+
+// Entry i is the class of (i + 1) * 8 bytes
+static const uint8_t size_class_table[SIZE_CLASS_TABLE_MAX / SIZE_CLASS_GRANULE] = {
+    SIZE_CLASS_E64(0), SIZE_CLASS_E64(64)};
+
+static inline size_t size_to_class(size_t size) {
+  if (size <= SIZE_CLASS_TABLE_MAX)
+    return size_class_table[(size - 1) / SIZE_CLASS_GRANULE];
+  return SIZE_CLASS_OF(size);
+}
+
+#endif
@@ -0,0 +1,62 @@
+#include "../src/my_allocator.hpp"
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * This test checks the C++ adaptors (make cxxtest): standard and pmr
+ * containers on the my_malloc heap, and over-aligned allocations.
+ **/
+
+struct alignas(64) Line {
+  char bytes[64];
+};
+
+static bool is_aligned(const void *ptr, std::size_t alignment) {
+  return (reinterpret_cast<std::uintptr_t>(ptr) & (alignment - 1)) == 0;
+}
+
+int main() {
+  std::vector<int, my_allocator<int>> ints;
+  for (int i = 0; i < 10000; i++)
+    ints.push_back(i);
+  for (int i = 0; i < 10000; i++)
+    assert(ints[i] == i);
+
+  std::unordered_map<int, int, std::hash<int>, std::equal_to<int>,
+                     my_allocator<std::pair<const int, int>>>
+      squares;
+  for (int i = 0; i < 1000; i++)
+    squares[i] = i * i;
+  assert(squares.size() == 1000 && squares[31] == 961);
+
+  std::vector<Line, my_allocator<Line>> lines(100);
+  assert(is_aligned(lines.data(), alignof(Line)));
+
+  std::pmr::vector<std::pmr::vector<int>> nested(my_heap_resource());
+  for (int i = 0; i < 100; i++)
+    nested.emplace_back(i, i);
+  assert(nested[99].size() == 99 && nested[99][98] == 99);
+  std::pmr::map<int, int> map(my_heap_resource());
+  for (int i = 0; i < 1000; i++)
+    map[i] = -i;
+  assert(map.begin()->second == 0 && map.rbegin()->second == -999);
+
+  for (std::size_t alignment = 16; alignment <= 8192; alignment <<= 1) {
+    void *ptrs[16];
+    for (int i = 0; i < 16; i++) {
+      ptrs[i] = my_aligned_alloc(alignment, 1 + i * 100);
+      assert(ptrs[i] != nullptr && is_aligned(ptrs[i], alignment));
+      std::memset(ptrs[i], i, 1 + i * 100);
+    }
+    for (int i = 0; i < 16; i += 2)
+      my_free(ptrs[i]);
+    for (int i = 1; i < 16; i += 2)
+      my_free(ptrs[i]);
+  }
+  assert(my_aligned_alloc(24, 8) == nullptr);
+  return 0;
+}
@@ -0,0 +1,74 @@
+#include "../src/mymalloc.h"
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+/**
+ * This test checks the operator new / delete replacements (src/my_new.cpp):
+ * every form allocates from the my_malloc heap, aligned forms honour the
+ * alignment and failures throw or return nullptr.
+ **/
+
+// Missing from glibc_shim, hence weak
+extern "C" Block *get_start_block(void) __attribute__((weak));
+extern "C" Block *get_next_block(Block *block) __attribute__((weak));
+
+struct alignas(256) Page {
+  char bytes[256];
+};
+
+// Let the huge requests below fail rather than abort under ASan (glibc_shim)
+extern "C" const char *__asan_default_options(void) { return "allocator_may_return_null=1"; }
+
+static bool in_heap(const void *ptr) {
+  if (get_start_block == nullptr)
+    return true;
+  for (Block *block = get_start_block(); block; block = get_next_block(block))
+    if (reinterpret_cast<char *>(block) + sizeof(Tag_t) == ptr)
+      return true;
+  return false;
+}
+
+static bool is_aligned(const void *ptr, std::size_t alignment) {
+  return (reinterpret_cast<std::uintptr_t>(ptr) & (alignment - 1)) == 0;
+}
+
+int main() {
+  int *one = new int(7);
+  assert(in_heap(one) && *one == 7);
+  delete one;
+
+  char *array = new char[1000];
+  assert(in_heap(array));
+  delete[] array;
+
+  Page *page = new Page;
+  assert(in_heap(page) && is_aligned(page, alignof(Page)));
+  delete page;
+  Page *pages = new Page[3];
+  assert(in_heap(pages) && is_aligned(pages, alignof(Page)));
+  delete[] pages;
+
+  auto shared = std::make_shared<std::string>(100, 'x');
+  auto owned = std::make_unique<std::vector<int>>(1000, 1);
+  assert(shared->size() == 100 && owned->size() == 1000);
+
+  void *empty = ::operator new(0);
+  assert(empty != nullptr && in_heap(empty));
+  ::operator delete(empty, std::size_t(0));
+
+  std::size_t huge = std::size_t(1) << 40;
+  assert(::operator new(huge, std::nothrow) == nullptr);
+  assert(::operator new(huge, std::align_val_t(64), std::nothrow) == nullptr);
+  bool thrown = false;
+  try {
+    (void)::operator new(huge);
+  } catch (const std::bad_alloc &) {
+    thrown = true;
+  }
+  assert(thrown);
+  return 0;
+}